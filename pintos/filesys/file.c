@@ -2,6 +2,9 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 /* An open file. */
 struct file {
@@ -71,7 +74,13 @@ file_get_inode (struct file *file) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
+#ifdef VM
+	/* Pages that shared mappings of the file hold are read from
+	 * memory. */
+	off_t bytes_read = vm_cache_read (file->inode, buffer, size, file->pos);
+#else
 	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+#endif
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -80,7 +89,9 @@ file_read (struct file *file, void *buffer, off_t size) {
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually read,
  * which may be less than SIZE if end of file is reached.
- * The file's current position is unaffected. */
+ * The file's current position is unaffected.
+ * Unlike file_read(), this always reads the disk: it is what the VM
+ * fills the pages of its file cache with. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
 	return inode_read_at (file->inode, buffer, size, file_ofs);
@@ -95,7 +106,14 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
+#ifdef VM
+	/* Pages that shared mappings of the file hold are written in
+	 * memory, and reach the disk when the mappings' changes do. */
+	off_t bytes_written = vm_cache_write (file->inode, buffer, size,
+			file->pos);
+#else
 	off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+#endif
 	file->pos += bytes_written;
 	return bytes_written;
 }
@@ -106,7 +124,9 @@ file_write (struct file *file, const void *buffer, off_t size) {
  * which may be less than SIZE if end of file is reached.
  * (Normally we'd grow the file in that case, but file growth is
  * not yet implemented.)
- * The file's current position is unaffected. */
+ * The file's current position is unaffected.
+ * Unlike file_write(), this always writes the disk: it is what the VM
+ * writes the pages of its file cache back with. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
 		off_t file_ofs) {
@@ -306,6 +306,12 @@ inode_allow_write (struct inode *inode) {
 	inode->deny_write_cnt--;
 }
 
+/* Returns true if writes to INODE are disabled. */
+bool
+inode_write_denied (const struct inode *inode) {
+	return inode->deny_write_cnt > 0;
+}
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode) {
@@ -0,0 +1,27 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ77-family compression.
+ *
+ * A byte-oriented codec in the style of LZ4: the output is a run
+ * of sequences, each a token byte, some literal bytes copied as
+ * they are, and a back reference to an earlier match.  It favours
+ * speed over ratio, which suits compressing whole pages on the
+ * eviction path.
+ *
+ * The compressor needs LZ_WORK_SIZE bytes of scratch memory from
+ * its caller, so that it can run on a small kernel stack.  Input
+ * must be smaller than 64 kB. */
+
+#include <stddef.h>
+
+/* Bytes of scratch memory for lz_compress(). */
+#define LZ_HASH_BITS 11
+#define LZ_WORK_SIZE ((1 << LZ_HASH_BITS) * 2)
+
+size_t lz_compress (const void *src, size_t size, void *dst, size_t dst_size,
+		void *work);
+size_t lz_decompress (const void *src, size_t size, void *dst,
+		size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
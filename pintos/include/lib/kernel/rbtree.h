@@ -0,0 +1,82 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * A balanced binary search tree: insertion, deletion and lookup
+ * take O(log n) time, and the elements can be visited in order.
+ * Besides exact matches, a tree can be searched for the nearest
+ * element below or above a key, which is what range lookups such
+ * as "which region contains this address" need.
+ *
+ * Like lists and hash tables, trees do not use dynamic
+ * allocation.  Each structure that can be in a tree embeds a
+ * struct rb_elem member, and rb_entry converts a struct rb_elem
+ * back to the structure that contains it.  Refer to
+ * lib/kernel/list.h for a detailed explanation of the technique.
+ *
+ * A tree whose memory is all zeroes is a valid empty tree, but
+ * it has no comparison function, so rb_init() must be called
+ * before the first insertion or search. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem {
+	struct rb_elem *parent;     /* Parent, or null for the root. */
+	struct rb_elem *left;       /* Left child. */
+	struct rb_elem *right;      /* Right child. */
+	bool red;                   /* Red or black? */
+};
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+ * structure that RB_ELEM is embedded inside.  Supply the name of
+ * the outer structure STRUCT and the member name MEMBER of the
+ * tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)                       \
+	((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent             \
+		- offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+		const struct rb_elem *b,
+		void *aux);
+
+/* Performs some operation on tree element E, given auxiliary
+ * data AUX. */
+typedef void rb_action_func (struct rb_elem *e, void *aux);
+
+/* Red-black tree. */
+struct rb_tree {
+	struct rb_elem *root;       /* Root, or null if empty. */
+	size_t elem_cnt;            /* Number of elements in tree. */
+	rb_less_func *less;         /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+/* Basic life cycle. */
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+void rb_clear (struct rb_tree *, rb_action_func *);
+
+/* Search, insertion, deletion. */
+struct rb_elem *rb_insert (struct rb_tree *, struct rb_elem *);
+void rb_remove (struct rb_tree *, struct rb_elem *);
+struct rb_elem *rb_find (const struct rb_tree *, const struct rb_elem *);
+struct rb_elem *rb_floor (const struct rb_tree *, const struct rb_elem *);
+struct rb_elem *rb_ceiling (const struct rb_tree *, const struct rb_elem *);
+
+/* Traversal, in ascending order. */
+struct rb_elem *rb_first (const struct rb_tree *);
+struct rb_elem *rb_last (const struct rb_tree *);
+struct rb_elem *rb_next (const struct rb_elem *);
+struct rb_elem *rb_prev (const struct rb_elem *);
+
+/* Information. */
+size_t rb_size (const struct rb_tree *);
+bool rb_empty (const struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
@@ -1,6 +1,8 @@
 #ifndef __LIB_SYSCALL_NR_H
 #define __LIB_SYSCALL_NR_H
 
+#include <stddef.h>
+
 /* System call numbers. */
 enum {
 	/* Projects 2 and later. */
@@ -36,6 +38,66 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Virtual memory extensions. */
+	SYS_MSYNC,                  /* Write back a memory mapping. */
+	SYS_MADVISE,                /* Give advice on using memory. */
+	SYS_FAULT_STATS,            /* Get page fault statistics. */
+	SYS_RSS_LIMIT,              /* Limit the resident set. */
+	SYS_MEM_USAGE,              /* Get memory use of this process. */
+	SYS_OOM_ADJ,                /* Adjust the out-of-memory badness. */
+	SYS_MEMMAP,                 /* Describe the memory of a process. */
+};
+
+/* Advice for madvise(). */
+enum {
+	MADV_NORMAL,                /* No special treatment. */
+	MADV_RANDOM,                /* Expect random access. */
+	MADV_SEQUENTIAL,            /* Expect sequential access. */
+	MADV_WILLNEED,              /* Will be needed soon; read it now. */
+	MADV_DONTNEED,              /* Not needed; zero it or reread it. */
+};
+
+/* What it took to resolve a page fault. */
+enum fault_cause {
+	FAULT_FILE,                 /* Read from a file. */
+	FAULT_ZERO,                 /* Zero-filled, or mapped the zero page. */
+	FAULT_OTHER,                /* First touch of a page in no region,
+	                               such as the initial stack page. */
+	FAULT_SWAP,                 /* Read back from swap. */
+	FAULT_COW,                  /* Write to a shared or merged page. */
+	FAULT_MINOR,                /* Already in memory again. */
+	FAULT_INVALID,              /* Bad access; the process is killed. */
+	FAULT_CAUSE_CNT
+};
+
+/* Buckets in fault latency histograms.  Bucket I counts faults that
+   took 2**I to 2**(I+1) - 1 TSC cycles; the last bucket also counts
+   slower ones. */
+#define FAULT_HIST_BUCKETS 32
+
+/* Page fault statistics, as returned by fault_stats(). */
+struct fault_stats {
+	long long count[FAULT_CAUSE_CNT];   /* Faults by cause. */
+	long long cycles[FAULT_CAUSE_CNT];  /* Total cycles by cause. */
+	long long hist[FAULT_CAUSE_CNT][FAULT_HIST_BUCKETS];
+};
+
+/* Range of oom_adj() values, in thousandths of user memory.  A process
+   whose value is OOM_ADJ_MIN is never killed for lack of memory. */
+#define OOM_ADJ_MIN (-1000)
+#define OOM_ADJ_MAX 1000
+
+/* Memory use of a process, as returned by mem_usage(). */
+struct mem_usage {
+	size_t rss;                 /* Pages resident now. */
+	size_t rss_peak;            /* Most pages ever resident. */
+	size_t rss_limit;           /* Limit set by rss_limit(), or 0. */
+	size_t swap;                /* Pages saved in swap only. */
+	long long reclaim;          /* Own pages evicted to stay under
+	                               the limit. */
+	size_t pt_pages;            /* Page-table pages of the address
+	                               space. */
 };
 
 #endif /* lib/syscall-nr.h */
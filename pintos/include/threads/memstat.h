@@ -0,0 +1,18 @@
+#ifndef THREADS_MEMSTAT_H
+#define THREADS_MEMSTAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* -mstat: Account kernel memory to the code that allocated it? */
+extern bool memstat_enabled;
+
+/* Identifies a call site in the accounting table. */
+typedef uint8_t memstat_site_t;
+
+memstat_site_t memstat_alloc (const void *caller, size_t size);
+void memstat_free (memstat_site_t, size_t size);
+void memstat_print_stats (void);
+
+#endif /* threads/memstat.h */
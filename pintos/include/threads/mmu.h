@@ -2,24 +2,54 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
+/* Largest batch that is invalidated page by page.  Past this, one
+ * CR3 reload is cheaper than the invlpgs plus the refills of the
+ * entries they would have spared. */
+#define MMU_GATHER_MAX 32
+
+/* A batch of PTE changes whose TLB invalidation is deferred. */
+struct mmu_gather {
+	uint64_t *pml4;                     /* Page table being changed. */
+	size_t page_cnt;                    /* Number of entries in PAGES. */
+	bool flush_all;                     /* Too many pages: flush all. */
+	const void *pages[MMU_GATHER_MAX];  /* Changed pages. */
+};
+
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
+uint64_t *pml4e_walk_huge (uint64_t *pml4, const uint64_t va, uint64_t size,
+		int create);
+void pml4_pool_init (void);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
+void pml4_free_tables (uint64_t *pml4, void *start, void *end);
+size_t pml4_table_cnt (uint64_t *pml4);
+void pml4_print_stats (void);
 void pml4_activate (uint64_t *pml4);
+void pml4_tlb_init (void);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_split_huge_page (uint64_t *pml4, void *upage);
 void pml4_clear_page (uint64_t *pml4, void *upage);
+void pml4_clear_range (uint64_t *pml4, void *upage, size_t n);
+void pml4_set_writable (uint64_t *pml4, void *upage, bool writable);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
 
+void mmu_gather_init (struct mmu_gather *, uint64_t *pml4);
+void mmu_gather_add (struct mmu_gather *, const void *va);
+void mmu_gather_clear_page (struct mmu_gather *, void *upage);
+void mmu_gather_finish (struct mmu_gather *);
+
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
 #define is_kern_pte(pte) (!is_user_pte (pte))
@@ -41,5 +41,12 @@
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=2 MB or 1 GB leaf (PDEs and PDPEs only). */
+#define PTE_G 0x100                      /* 1=global, kept across CR3 loads. */
+
+/* Bytes mapped by a page directory entry and by a page directory
+   pointer entry that have PTE_PS set. */
+#define HUGE_PGSIZE  (1UL << PDXSHIFT)   /* 2 MB. */
+#define GIANT_PGSIZE (1UL << PDPESHIFT)  /* 1 GB. */
 
 #endif /* threads/pte.h */
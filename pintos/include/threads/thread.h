@@ -91,6 +91,7 @@ struct thread {
 	enum thread_status status;          /* Thread state. */
 	char name[16];                      /* Name (for debugging purposes). */
 	int priority;                       /* Priority. */
+	struct list_elem allelem;           /* List element for all threads list. */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
@@ -98,10 +99,27 @@ struct thread {
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint64_t *pml4;                     /* Page map level 4 */
+	int exit_status;                    /* Status to exit with. */
+	struct process_child *child;        /* Shared with the parent that
+	                                       may wait for it, or NULL. */
+	struct list children;               /* Children not waited for. */
+	struct file **fd_table;             /* Open files by descriptor, or
+	                                       NULL until the first open. */
 #endif
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+
+	/* Resident set, in pages, protected by the frame table lock. */
+	size_t rss;                         /* Pages mapped to frames. */
+	size_t rss_peak;                    /* Most pages ever resident. */
+	size_t rss_limit;                   /* Most pages resident, or 0. */
+	size_t swap_cnt;                    /* Pages saved in swap only. */
+	long long reclaim_cnt;              /* Own pages evicted to stay
+	                                       under RSS_LIMIT. */
+	int oom_adj;                        /* Added to the OOM badness, in
+	                                       thousandths of user memory. */
+	bool oom_killed;                    /* Exits at its next user fault. */
 #endif
 
 	/* Owned by thread.c. */
@@ -133,6 +151,10 @@ const char *thread_name (void);
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
 
+/* Performs some operation on thread t, given auxiliary data AUX. */
+typedef void thread_action_func (struct thread *t, void *aux);
+void thread_foreach (thread_action_func *, void *);
+
 int thread_get_priority (void);
 void thread_set_priority (int);
 
@@ -8,6 +8,17 @@ tid_t process_fork (const char *name, struct intr_frame *if_);
 int process_exec (void *f_name);
 int process_wait (tid_t);
 void process_exit (void);
+void process_terminate (int status) NO_RETURN;
 void process_activate (struct thread *next);
 
+/* File descriptors 0 and 1 are the console, so the first file opened
+ * gets 2. */
+#define FD_MIN 2
+#define FD_MAX 128
+
+struct file;
+int process_add_file (struct file *);
+struct file *process_get_file (int fd);
+void process_close_file (int fd);
+
 #endif /* userprog/process.h */
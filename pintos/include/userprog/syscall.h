@@ -1,6 +1,12 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "threads/synch.h"
+
+/* Serializes the file system calls, since the file system does no
+ * locking of its own. */
+extern struct lock filesys_lock;
+
 void syscall_init (void);
 
 #endif /* userprog/syscall.h */
@@ -2,12 +2,28 @@
 #define VM_ANON_H
 #include "vm/vm.h"
 struct page;
+struct zswap_entry;
 enum vm_type;
 
+/* No swap slot. */
+#define ANON_NO_SLOT ((size_t) -1)
+
 struct anon_page {
+	size_t slot;           /* Swap slot with a copy of the page, or
+	                          ANON_NO_SLOT. */
+	struct zswap_entry *zswap;  /* Compressed copy, or NULL. */
+	bool zero;             /* Page was all zeros when last saved. */
+	bool modified;         /* No longer matches its region. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_swap_readahead (struct page *page);
+bool anon_is_swapped (const struct page *page);
+bool anon_read_swap (struct page *page, void *kva);
+bool anon_write_slot (struct page *page, const void *kva);
+bool anon_needs_write (const struct page *page, uint64_t *pml4);
+void anon_share_copy (struct page *page, const struct page *src);
+void vm_anon_print_stats (void);
 
 #endif
@@ -14,4 +14,10 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+int do_msync (void *addr, size_t length);
+bool file_backed_write_back (struct page *page);
+void vm_file_print_stats (void);
+
+/* Milliseconds between writebacks of dirty mapped pages. */
+extern unsigned vm_flush_interval;
 #endif
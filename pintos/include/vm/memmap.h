@@ -0,0 +1,8 @@
+#ifndef VM_MEMMAP_H
+#define VM_MEMMAP_H
+#include <stddef.h>
+#include "threads/thread.h"
+
+int memmap_get (tid_t tid, char *buf, size_t size);
+
+#endif
@@ -1,7 +1,13 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
+#include <list.h>
+#include <rbtree.h>
+#include <syscall-nr.h>
 #include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
 
 enum vm_type {
 	/* page not initialized */
@@ -32,10 +38,15 @@ enum vm_type {
 #endif
 
 struct page_operations;
+struct inode;
+struct mmu_gather;
 struct thread;
 
 #define VM_TYPE(type) ((type) & 7)
 
+/* Pages in a frame that backs a 2 MB user page. */
+#define HUGE_PAGE_CNT (HUGE_PGSIZE / PGSIZE)
+
 /* The representation of "page".
  * This is kind of "parent class", which has four "child class"es, which are
  * uninit_page, file_page, anon_page, and page cache (project4).
@@ -46,6 +57,10 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct rb_elem spt_elem;     /* Element in the SPT's page tree. */
+	struct vm_region *region;    /* Region this page belongs to, or NULL. */
+	bool writable;               /* May the process write to the page? */
+	bool huge;                   /* Maps a whole huge frame? */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -59,10 +74,40 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* A mapping of a frame, in the reverse map of the frame: PAGE, which
+ * OWNER maps in its page table. */
+struct rmap_entry {
+	struct page *page;
+	struct thread *owner;
+};
+
+/* The representation of "frame"
+ * The reverse map of a frame lists every page that maps it.  Most
+ * frames are mapped by one page only, which PAGE and OWNER name, so
+ * only frames shared by copy-on-write, the page cache or same-page
+ * merging need the RMAP array for the others. */
 struct frame {
 	void *kva;
 	struct page *page;
+
+	struct list_elem elem;       /* Element in the frame table. */
+	struct thread *owner;        /* Process whose page table maps PAGE. */
+	bool pinned;                 /* Being filled; not to be evicted. */
+	bool evicting;               /* Being written out, without
+	                                frame_lock; see page_frame_wait(). */
+	unsigned ref_cnt;            /* Pages that map it: PAGE, and then
+	                                REF_CNT - 1 entries of RMAP. */
+	struct rmap_entry *rmap;     /* Other mappings, or NULL. */
+	unsigned rmap_cap;           /* Entries allocated in RMAP. */
+	struct cache_entry *cache;   /* Entry in the page cache, or NULL. */
+	bool huge;                   /* HUGE_PAGE_CNT pages, mapped with one
+	                                page directory entry? */
+
+	/* Same-page merging. */
+	bool merged;                 /* Shared by merging identical pages? */
+	uint64_t sum;                /* Hash of contents at the last scan. */
+	bool listed;                 /* In the merge table? */
+	struct hash_elem ksm_elem;   /* Element in the merge table. */
 };
 
 /* The function table for page operations.
@@ -81,10 +126,48 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
+/* A range of user virtual address space with the same backing and
+ * permissions, like a Unix VMA.  A region only describes its pages: a
+ * struct page is created for one of them when it is first faulted in,
+ * so a large lazily mapped region costs one struct vm_region until it
+ * is touched.
+ *
+ * The first READ_BYTES bytes of the region come from FILE starting at
+ * OFFSET and the rest is zeroed.  A VM_ANON region with a file is a
+ * private mapping, such as an executable's data segment: its pages
+ * never go back to the file.  A VM_FILE region is a shared mapping
+ * made by mmap(), whose dirty pages are written back to FILE. */
+struct vm_region {
+	struct rb_elem elem;         /* Element in the SPT's region tree. */
+	void *start;                 /* First page. */
+	void *end;                   /* One past the last page. */
+	enum vm_type type;           /* VM_ANON or VM_FILE. */
+	bool writable;               /* May the process write to it? */
+	struct file *file;           /* Backing file, owned, or NULL. */
+	off_t offset;                /* Offset in FILE of START. */
+	size_t read_bytes;           /* Bytes of FILE mapped from START. */
+	void *ra_next;               /* Where a sequential fault would be. */
+	size_t ra_pages;             /* Pages mapped around the last fault. */
+	int advice;                  /* MADV_NORMAL, _RANDOM or _SEQUENTIAL. */
+};
+
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ * Regions and the pages materialized from them, or allocated on
+ * their own by vm_alloc_page_with_initializer(), are kept in two
+ * red-black trees ordered by address, so that looking up the page or
+ * region that covers a faulting address takes O(log n).  A zeroed
+ * SPT is empty and may be killed without being initialized.
+ *
+ * Only the owning process changes its SPT, so it reads it without
+ * locking.  Changes are made under LOCK so that eviction, which runs
+ * in other processes, can look for neighbors of a victim page; it
+ * only ever tries to take LOCK, because it already holds the frame
+ * table lock, which the owner may need while it holds LOCK. */
 struct supplemental_page_table {
+	struct rb_tree regions;      /* struct vm_region, by start. */
+	struct rb_tree pages;        /* struct page, by va. */
+	struct lock lock;            /* Held to change either tree. */
+	struct thread *owner;        /* Process it describes. */
 };
 
 #include "threads/thread.h"
@@ -96,16 +179,67 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+struct page *spt_get_page (struct supplemental_page_table *spt, void *va);
+struct vm_region *spt_find_region (struct supplemental_page_table *spt,
+		void *va);
+bool spt_insert_region (struct supplemental_page_table *spt,
+		struct vm_region *region);
+void spt_remove_region (struct supplemental_page_table *spt,
+		struct vm_region *region);
 
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
+enum fault_cause vm_handle_fault (void *addr, bool write, bool not_present);
 
 #define vm_alloc_page(type, upage, writable) \
 	vm_alloc_page_with_initializer ((type), (upage), (writable), NULL, NULL)
 bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
+bool vm_alloc_region (void *start, size_t length, enum vm_type type,
+		bool writable, struct file *file, off_t offset, size_t read_bytes);
+void vm_free_frame (struct page *page);
+bool vm_file_free_frame (struct page *page);
+off_t vm_cache_read (struct inode *inode, void *buffer, off_t size,
+		off_t offset);
+off_t vm_cache_write (struct inode *inode, const void *buffer, off_t size,
+		off_t offset);
+bool vm_region_fill (struct vm_region *region, void *va, void *kva);
+size_t vm_evict_cluster (struct page *page, struct page **pages, size_t cnt,
+		bool (*accept) (const struct page *first, const struct page *),
+		struct mmu_gather *tlb);
+void vm_evict_cluster_done (struct page *page);
+void vm_evict_io_begin (void);
+void vm_evict_io_end (void);
+bool vm_prefetch_page (struct page *page);
+void vm_print_stats (void);
+size_t vm_writeback_all (void);
+size_t vm_writeback_range (void *start, void *end);
+int do_madvise (void *addr, size_t length, int advice);
+size_t vm_set_rss_limit (size_t pages);
+int vm_set_oom_adj (int adj);
+void vm_get_mem_usage (struct mem_usage *usage);
+bool vm_is_zero_frame (const struct frame *frame);
+bool vm_frame_table_try_lock (void);
+void vm_frame_table_unlock (void);
+
+/* Pages mapped around a fault on file data. */
+extern unsigned vm_fault_around;
+
+/* Free-frame watermarks of the pageout thread, in percent. */
+extern unsigned vm_wmark_low;
+extern unsigned vm_wmark_high;
+
+/* Back aligned 2 MB blocks of zero-filled memory with huge frames? */
+extern bool vm_huge_pages;
+
+/* Resident-set limit of programs when they start, in pages, or 0. */
+extern size_t vm_rss_limit;
+
+/* Frames scanned for same-page merging every vm_ksm_interval ms. */
+extern unsigned vm_ksm_pages;
+extern unsigned vm_ksm_interval;
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
 
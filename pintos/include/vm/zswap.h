@@ -0,0 +1,17 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+struct page;
+
+/* Size of the compressed pool, as a percentage of the user pool. */
+extern unsigned zswap_percent;
+
+void zswap_init (void);
+bool zswap_store (struct page *page, const void *kva);
+void zswap_load (struct page *page, void *kva, bool keep);
+void zswap_invalidate (struct page *page);
+void zswap_print_stats (void);
+
+#endif
@@ -3,6 +3,8 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -21,12 +23,26 @@ typedef unsigned long elem_type;
 /* Number of bits in an element. */
 #define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
 
+/* Minimum number of elements for which a bitmap keeps a
+   summary.  Smaller bitmaps are scanned fast enough without
+   one. */
+#define SUMMARY_MIN_ELEMS ELEM_BITS
+
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   Large bitmaps also keep a two-level summary: bit I of FULL is
+   set if and only if element I of BITS has all of its bits set,
+   and bit I of EMPTY is set if and only if element I of BITS has
+   none of its bits set.  Scans use the summary to skip
+   ELEM_BITS elements (ELEM_BITS * ELEM_BITS bits) at a time.
+   Small bitmaps have null FULL and EMPTY. */
 struct bitmap {
 	size_t bit_cnt;     /* Number of bits. */
 	elem_type *bits;    /* Elements that represent bits. */
+	elem_type *full;    /* Summary of completely set elements. */
+	elem_type *empty;   /* Summary of completely clear elements. */
 };
 
 /* Returns the index of the element that contains the bit
@@ -62,6 +78,69 @@ last_mask (const struct bitmap *b) {
 	int last_bits = b->bit_cnt % ELEM_BITS;
 	return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the number of summary elements required for a bitmap
+   of BIT_CNT bits, which is 0 if it does not keep a summary. */
+static inline size_t
+summary_cnt (size_t bit_cnt) {
+	size_t elems = elem_cnt (bit_cnt);
+	return elems >= SUMMARY_MIN_ELEMS ? elem_cnt (elems) : 0;
+}
+
+/* Returns the number of bytes required for the bits and summary
+   of a bitmap of BIT_CNT bits. */
+static inline size_t
+storage_cnt (size_t bit_cnt) {
+	return byte_cnt (bit_cnt) + 2 * sizeof (elem_type) * summary_cnt (bit_cnt);
+}
+
+/* Returns a bit mask of the bits actually used in element IDX
+   of B's bits. */
+static inline elem_type
+elem_mask (const struct bitmap *b, size_t idx) {
+	return idx == elem_cnt (b->bit_cnt) - 1 ? last_mask (b) : (elem_type) -1;
+}
+
+/* Points B's summary at the storage following its
+   elements, or clears it if B is too small to have one. */
+static void
+summary_attach (struct bitmap *b) {
+	size_t cnt = summary_cnt (b->bit_cnt);
+	if (cnt > 0) {
+		b->full = b->bits + elem_cnt (b->bit_cnt);
+		b->empty = b->full + cnt;
+		memset (b->full, 0, 2 * sizeof (elem_type) * cnt);
+	} else
+		b->full = b->empty = NULL;
+}
+
+/* Brings the summary bits for element IDX of B up to date with
+   the element's current contents. */
+static void
+summary_update (struct bitmap *b, size_t idx) {
+	size_t sum_idx = elem_idx (idx);
+	elem_type mask = bit_mask (idx);
+	elem_type bits;
+	enum intr_level old_level;
+
+	if (b->full == NULL)
+		return;
+
+	/* Reading the element and writing the summary must not be
+	   interleaved with another update of the same element, or the
+	   summary could be left describing a stale value. */
+	old_level = intr_disable ();
+	bits = b->bits[idx];
+	if (bits == elem_mask (b, idx))
+		b->full[sum_idx] |= mask;
+	else
+		b->full[sum_idx] &= ~mask;
+	if (bits == 0)
+		b->empty[sum_idx] |= mask;
+	else
+		b->empty[sum_idx] &= ~mask;
+	intr_set_level (old_level);
+}
 
 /* Creation and destruction. */
 
@@ -74,8 +153,9 @@ bitmap_create (size_t bit_cnt) {
 	struct bitmap *b = malloc (sizeof *b);
 	if (b != NULL) {
 		b->bit_cnt = bit_cnt;
-		b->bits = malloc (byte_cnt (bit_cnt));
+		b->bits = malloc (storage_cnt (bit_cnt));
 		if (b->bits != NULL || bit_cnt == 0) {
+			summary_attach (b);
 			bitmap_set_all (b, false);
 			return b;
 		}
@@ -95,6 +175,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED) {
 
 	b->bit_cnt = bit_cnt;
 	b->bits = (elem_type *) (b + 1);
+	summary_attach (b);
 	bitmap_set_all (b, false);
 	return b;
 }
@@ -103,7 +184,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED) {
    with BIT_CNT bits (for use with bitmap_create_in_buf()). */
 size_t
 bitmap_buf_size (size_t bit_cnt) {
-	return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+	return sizeof (struct bitmap) + storage_cnt (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -148,6 +229,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx) {
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the OR instruction in [IA32-v2b]. */
 	asm ("lock orq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+	summary_update (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -160,6 +242,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx) {
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the AND instruction in [IA32-v2a]. */
 	asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+	summary_update (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -174,6 +257,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx) {
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the XOR instruction in [IA32-v2b]. */
 	asm ("lock xorq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+	summary_update (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -184,6 +268,69 @@ bitmap_test (const struct bitmap *b, size_t idx) {
 	return (b->bits[elem_idx (idx)] & bit_mask (idx)) != 0;
 }
 
+/* Word-at-a-time searching. */
+
+/* Returns element IDX of B with its bits inverted if VALUE is
+   false, so that the bits equal to VALUE read as 1.  Bits past
+   the end of B read as 0 either way. */
+static inline elem_type
+elem_load (const struct bitmap *b, size_t idx, bool value) {
+	elem_type bits = b->bits[idx];
+	return value ? bits : ~bits & elem_mask (b, idx);
+}
+
+/* Returns the index of the first element of B at or after IDX
+   that might contain a bit set to VALUE, or a value of at least
+   elem_cnt (B->bit_cnt) if there is none.  Without a summary,
+   this is just IDX.  With one, elements that are known to hold
+   only !VALUE bits are skipped ELEM_BITS at a time. */
+static size_t
+next_candidate_elem (const struct bitmap *b, size_t idx, bool value) {
+	const elem_type *skip = value ? b->empty : b->full;
+	size_t sum_cnt, sum_idx;
+	elem_type cand;
+
+	if (skip == NULL)
+		return idx;
+
+	sum_cnt = summary_cnt (b->bit_cnt);
+	sum_idx = elem_idx (idx);
+	if (sum_idx >= sum_cnt)
+		return idx;
+
+	cand = ~skip[sum_idx] & ((elem_type) -1 << (idx % ELEM_BITS));
+	while (cand == 0) {
+		if (++sum_idx >= sum_cnt)
+			return sum_idx * ELEM_BITS;
+		cand = ~skip[sum_idx];
+	}
+	return sum_idx * ELEM_BITS + __builtin_ctzl (cand);
+}
+
+/* Returns the index of the first bit in B at or after START and
+   before END that is set to VALUE, or END if there is none. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value) {
+	size_t idx, last_idx, bit_idx;
+	elem_type bits;
+
+	if (start >= end)
+		return end;
+
+	idx = elem_idx (start);
+	last_idx = elem_idx (end - 1);
+	bits = elem_load (b, idx, value) & ((elem_type) -1 << (start % ELEM_BITS));
+	while (bits == 0) {
+		idx = next_candidate_elem (b, idx + 1, value);
+		if (idx > last_idx)
+			return end;
+		bits = elem_load (b, idx, value);
+	}
+
+	bit_idx = idx * ELEM_BITS + __builtin_ctzl (bits);
+	return bit_idx < end ? bit_idx : end;
+}
+
 /* Setting and testing multiple bits. */
 
 /* Sets all bits in B to VALUE. */
@@ -194,17 +341,31 @@ bitmap_set_all (struct bitmap *b, bool value) {
 	bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Works a whole element at a time; each element is updated
+   atomically. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	while (start < end) {
+		size_t idx = elem_idx (start);
+		size_t ofs = start % ELEM_BITS;
+		size_t n = ELEM_BITS - ofs < end - start ? ELEM_BITS - ofs : end - start;
+		elem_type mask = (n == ELEM_BITS ? (elem_type) -1
+				: (((elem_type) 1 << n) - 1)) << ofs;
+
+		if (value)
+			asm ("lock orq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+		else
+			asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+		summary_update (b, idx);
+		start += n;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -228,16 +389,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return find_next (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -272,12 +428,26 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
+	if (cnt == 0)
+		return start;
 	if (cnt <= b->bit_cnt) {
 		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
+		size_t i = start;
+		while (i <= last) {
+			/* Find the start of the next run of VALUE bits, then the
+			   first !VALUE bit that would cut it short.  A run that
+			   is cut short cannot contain a group, so resume the
+			   search just past the bit that ended it. */
+			size_t run_end;
+
+			i = find_next (b, i, last + 1, value);
+			if (i > last)
+				break;
+			run_end = find_next (b, i, i + cnt, !value);
+			if (run_end == i + cnt)
 				return i;
+			i = run_end + 1;
+		}
 	}
 	return BITMAP_ERROR;
 }
@@ -313,8 +483,11 @@ bitmap_read (struct bitmap *b, struct file *file) {
 	bool success = true;
 	if (b->bit_cnt > 0) {
 		off_t size = byte_cnt (b->bit_cnt);
+		size_t i;
 		success = file_read_at (file, b->bits, size, 0) == size;
 		b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+		for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+			summary_update (b, i);
 	}
 	return success;
 }
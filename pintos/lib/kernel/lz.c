@@ -0,0 +1,184 @@
+/* LZ77-family compression.
+
+   See lz.h for basic information.
+
+   A compressed stream is a series of sequences.  Each begins with
+   a token byte whose upper 4 bits give the number of literal bytes
+   that follow it and whose lower 4 bits give the length of the
+   match after them, less MIN_MATCH.  A nibble of 15 means that the
+   length continues in the following bytes, each added to it, until
+   one that is less than 255.  The literals come next, then the
+   match offset as 2 little-endian bytes, then the rest of the match
+   length.  The last sequence has literals only: the stream ends
+   right after them. */
+
+#include "lz.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Shortest match worth encoding. */
+#define MIN_MATCH 4
+
+/* Farthest back a match can start. */
+#define MAX_OFFSET 0xffff
+
+/* Reads 4 bytes at P as a little-endian word. */
+static inline uint32_t
+read32 (const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Returns the hash table index for the 4 bytes SEQ. */
+static inline size_t
+hash_seq (uint32_t seq) {
+	return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes length LEN, which did not fit in its token nibble, to *OP
+   as continuation bytes.  Returns false if it would pass END. */
+static bool
+put_length (uint8_t **op, uint8_t *end, size_t len) {
+	for (; len >= 255; len -= 255) {
+		if (*op >= end)
+			return false;
+		*(*op)++ = 255;
+	}
+	if (*op >= end)
+		return false;
+	*(*op)++ = len;
+	return true;
+}
+
+/* Reads the rest of a length whose token nibble was 15 from *IP
+   and adds it to *LEN.  Returns false if it runs past END. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *end, size_t *len) {
+	uint8_t b;
+
+	do {
+		if (*ip >= end)
+			return false;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return true;
+}
+
+/* Writes a sequence of the LIT_LEN literals at LIT followed, if
+   MATCH_LEN is nonzero, by a match of MATCH_LEN bytes OFFSET bytes
+   back.  Returns false if it would pass END. */
+static bool
+put_sequence (uint8_t **op, uint8_t *end, const uint8_t *lit,
+		size_t lit_len, size_t offset, size_t match_len) {
+	size_t ml = match_len != 0 ? match_len - MIN_MATCH : 0;
+	uint8_t *token = *op;
+
+	if (*op >= end)
+		return false;
+	*token = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+	(*op)++;
+	if (lit_len >= 15 && !put_length (op, end, lit_len - 15))
+		return false;
+	if (lit_len > (size_t) (end - *op))
+		return false;
+	memcpy (*op, lit, lit_len);
+	*op += lit_len;
+	if (match_len == 0)
+		return true;
+
+	if (end - *op < 2)
+		return false;
+	*(*op)++ = offset;
+	*(*op)++ = offset >> 8;
+	if (ml >= 15 && !put_length (op, end, ml - 15))
+		return false;
+	return true;
+}
+
+/* Compresses the SIZE bytes at SRC into the DST_SIZE bytes at
+   DST, using the LZ_WORK_SIZE bytes at WORK as scratch memory.
+   Returns the size of the compressed data, or 0 if it does not
+   fit in DST_SIZE bytes. */
+size_t
+lz_compress (const void *src_, size_t size, void *dst_, size_t dst_size,
+		void *work) {
+	const uint8_t *src = src_;
+	uint8_t *dst = dst_;
+	uint8_t *op = dst;
+	uint8_t *end = dst + dst_size;
+	uint16_t *table = work;
+	size_t ip = 0, anchor = 0;
+
+	memset (table, 0, LZ_WORK_SIZE);
+	while (ip + MIN_MATCH <= size) {
+		uint32_t seq = read32 (src + ip);
+		size_t h = hash_seq (seq);
+		size_t ref = table[h];
+		size_t len;
+
+		table[h] = ip;
+		if (ref >= ip || ip - ref > MAX_OFFSET || read32 (src + ref) != seq) {
+			ip++;
+			continue;
+		}
+
+		len = MIN_MATCH;
+		while (ip + len < size && src[ref + len] == src[ip + len])
+			len++;
+		if (!put_sequence (&op, end, src + anchor, ip - anchor, ip - ref, len))
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+	if (!put_sequence (&op, end, src + anchor, size - anchor, 0, 0))
+		return 0;
+	return op - dst;
+}
+
+/* Decompresses the SIZE bytes at SRC into the DST_SIZE bytes at
+   DST.  Returns the size of the decompressed data, or 0 if SRC is
+   not a valid compressed stream or does not fit in DST_SIZE
+   bytes. */
+size_t
+lz_decompress (const void *src_, size_t size, void *dst_, size_t dst_size) {
+	const uint8_t *ip = src_;
+	const uint8_t *ip_end = ip + size;
+	uint8_t *dst = dst_;
+	uint8_t *op = dst;
+	uint8_t *op_end = dst + dst_size;
+
+	while (ip < ip_end) {
+		uint8_t token = *ip++;
+		size_t lit_len = token >> 4;
+		size_t match_len = token & 15;
+		size_t offset;
+
+		if (lit_len == 15 && !get_length (&ip, ip_end, &lit_len))
+			return 0;
+		if (lit_len > (size_t) (ip_end - ip)
+				|| lit_len > (size_t) (op_end - op))
+			return 0;
+		memcpy (op, ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+		if (ip == ip_end)
+			break;
+
+		if (ip_end - ip < 2)
+			return 0;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (match_len == 15 && !get_length (&ip, ip_end, &match_len))
+			return 0;
+		match_len += MIN_MATCH;
+		if (offset == 0 || offset > (size_t) (op - dst)
+				|| match_len > (size_t) (op_end - op))
+			return 0;
+
+		/* Byte at a time: the match may overlap what it produces. */
+		for (; match_len > 0; match_len--, op++)
+			*op = op[-offset];
+	}
+	return op - dst;
+}
@@ -0,0 +1,414 @@
+/* Red-black tree.
+
+   See rbtree.h for basic information.
+
+   The implementation follows Cormen, Leiserson, Rivest and
+   Stein, "Introduction to Algorithms", chapter 13, except that
+   leaves are null pointers instead of a sentinel node, so that
+   a zeroed tree is empty and removal has to track the parent of
+   the node that replaced the removed one. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static bool is_red (const struct rb_elem *);
+static void replace_child (struct rb_tree *, struct rb_elem *parent,
+		struct rb_elem *old, struct rb_elem *new);
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void insert_fixup (struct rb_tree *, struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+		struct rb_elem *parent);
+static struct rb_elem *leftmost (struct rb_elem *);
+static struct rb_elem *rightmost (struct rb_elem *);
+
+/* Initializes tree T to compare elements using LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux) {
+	ASSERT (t != NULL);
+	ASSERT (less != NULL);
+
+	t->root = NULL;
+	t->elem_cnt = 0;
+	t->less = less;
+	t->aux = aux;
+}
+
+/* Removes all the elements from T.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the tree, children before their parents.  DESTRUCTOR may
+   deallocate the memory used by the element, but it must not
+   otherwise use or modify T. */
+void
+rb_clear (struct rb_tree *t, rb_action_func *destructor) {
+	struct rb_elem *e = t->root;
+
+	while (e != NULL) {
+		if (e->left != NULL)
+			e = e->left;
+		else if (e->right != NULL)
+			e = e->right;
+		else {
+			struct rb_elem *parent = e->parent;
+
+			if (parent == NULL)
+				;
+			else if (parent->left == e)
+				parent->left = NULL;
+			else
+				parent->right = NULL;
+			if (destructor != NULL)
+				destructor (e, t->aux);
+			e = parent;
+		}
+	}
+
+	t->root = NULL;
+	t->elem_cnt = 0;
+}
+
+/* Inserts NEW into tree T and returns a null pointer, if no
+   equal element is already in the tree.
+   If an equal element is already in the tree, returns it
+   without inserting NEW. */
+struct rb_elem *
+rb_insert (struct rb_tree *t, struct rb_elem *new) {
+	struct rb_elem **link = &t->root;
+	struct rb_elem *parent = NULL;
+
+	while (*link != NULL) {
+		parent = *link;
+		if (t->less (new, parent, t->aux))
+			link = &parent->left;
+		else if (t->less (parent, new, t->aux))
+			link = &parent->right;
+		else
+			return parent;
+	}
+
+	new->parent = parent;
+	new->left = new->right = NULL;
+	new->red = true;
+	*link = new;
+	t->elem_cnt++;
+	insert_fixup (t, new);
+	return NULL;
+}
+
+/* Removes element E, which must be in tree T. */
+void
+rb_remove (struct rb_tree *t, struct rb_elem *e) {
+	struct rb_elem *x, *x_parent;
+	bool removed_red;
+
+	ASSERT (t->elem_cnt > 0);
+
+	if (e->left == NULL || e->right == NULL) {
+		/* E has at most one child, which takes its place. */
+		x = e->left != NULL ? e->left : e->right;
+		x_parent = e->parent;
+		removed_red = e->red;
+		replace_child (t, e->parent, e, x);
+		if (x != NULL)
+			x->parent = e->parent;
+	} else {
+		/* E's successor Y, which has no left child, takes E's place
+		   and color, and Y's right child takes Y's place. */
+		struct rb_elem *y = leftmost (e->right);
+
+		removed_red = y->red;
+		x = y->right;
+		if (y->parent == e)
+			x_parent = y;
+		else {
+			x_parent = y->parent;
+			replace_child (t, y->parent, y, x);
+			if (x != NULL)
+				x->parent = y->parent;
+			y->right = e->right;
+			y->right->parent = y;
+		}
+		replace_child (t, e->parent, e, y);
+		y->parent = e->parent;
+		y->left = e->left;
+		y->left->parent = y;
+		y->red = e->red;
+	}
+
+	t->elem_cnt--;
+	if (!removed_red)
+		remove_fixup (t, x, x_parent);
+}
+
+/* Finds and returns an element equal to E in tree T, or a null
+   pointer if no equal element exists in the tree. */
+struct rb_elem *
+rb_find (const struct rb_tree *t, const struct rb_elem *e) {
+	struct rb_elem *found = rb_floor (t, e);
+
+	return found != NULL && !t->less (found, e, t->aux) ? found : NULL;
+}
+
+/* Returns the greatest element in tree T that is less than or
+   equal to E, or a null pointer if every element is greater. */
+struct rb_elem *
+rb_floor (const struct rb_tree *t, const struct rb_elem *e) {
+	struct rb_elem *cur = t->root;
+	struct rb_elem *best = NULL;
+
+	while (cur != NULL)
+		if (t->less (e, cur, t->aux))
+			cur = cur->left;
+		else {
+			best = cur;
+			cur = cur->right;
+		}
+	return best;
+}
+
+/* Returns the least element in tree T that is greater than or
+   equal to E, or a null pointer if every element is less. */
+struct rb_elem *
+rb_ceiling (const struct rb_tree *t, const struct rb_elem *e) {
+	struct rb_elem *cur = t->root;
+	struct rb_elem *best = NULL;
+
+	while (cur != NULL)
+		if (t->less (cur, e, t->aux))
+			cur = cur->right;
+		else {
+			best = cur;
+			cur = cur->left;
+		}
+	return best;
+}
+
+/* Returns the least element in tree T, or a null pointer if T
+   is empty. */
+struct rb_elem *
+rb_first (const struct rb_tree *t) {
+	return t->root != NULL ? leftmost (t->root) : NULL;
+}
+
+/* Returns the greatest element in tree T, or a null pointer if T
+   is empty. */
+struct rb_elem *
+rb_last (const struct rb_tree *t) {
+	return t->root != NULL ? rightmost (t->root) : NULL;
+}
+
+/* Returns the element after E in its tree, or a null pointer if
+   E is the greatest element. */
+struct rb_elem *
+rb_next (const struct rb_elem *e) {
+	if (e->right != NULL)
+		return leftmost (e->right);
+	while (e->parent != NULL && e == e->parent->right)
+		e = e->parent;
+	return e->parent;
+}
+
+/* Returns the element before E in its tree, or a null pointer
+   if E is the least element. */
+struct rb_elem *
+rb_prev (const struct rb_elem *e) {
+	if (e->left != NULL)
+		return rightmost (e->left);
+	while (e->parent != NULL && e == e->parent->left)
+		e = e->parent;
+	return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (const struct rb_tree *t) {
+	return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+rb_empty (const struct rb_tree *t) {
+	return t->elem_cnt == 0;
+}
+
+/* Returns true if E is a red node.  Leaves are black. */
+static bool
+is_red (const struct rb_elem *e) {
+	return e != NULL && e->red;
+}
+
+/* Makes NEW take OLD's place as a child of PARENT in T, or as
+   T's root if PARENT is null.  Does not update NEW's parent. */
+static void
+replace_child (struct rb_tree *t, struct rb_elem *parent,
+		struct rb_elem *old, struct rb_elem *new) {
+	if (parent == NULL)
+		t->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+/* Rotates the subtree rooted at X to the left, making X's right
+   child its root. */
+static void
+rotate_left (struct rb_tree *t, struct rb_elem *x) {
+	struct rb_elem *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	replace_child (t, x->parent, x, y);
+	y->parent = x->parent;
+	y->left = x;
+	x->parent = y;
+}
+
+/* Rotates the subtree rooted at X to the right, making X's left
+   child its root. */
+static void
+rotate_right (struct rb_tree *t, struct rb_elem *x) {
+	struct rb_elem *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	replace_child (t, x->parent, x, y);
+	y->parent = x->parent;
+	y->right = x;
+	x->parent = y;
+}
+
+/* Restores the red-black properties of T after red node E was
+   inserted. */
+static void
+insert_fixup (struct rb_tree *t, struct rb_elem *e) {
+	struct rb_elem *p;
+
+	while ((p = e->parent) != NULL && p->red) {
+		/* P is red, so it is not the root and has a parent. */
+		struct rb_elem *g = p->parent;
+
+		if (p == g->left) {
+			struct rb_elem *u = g->right;
+
+			if (is_red (u)) {
+				p->red = u->red = false;
+				g->red = true;
+				e = g;
+			} else {
+				if (e == p->right) {
+					rotate_left (t, p);
+					e = p;
+					p = e->parent;
+				}
+				p->red = false;
+				g->red = true;
+				rotate_right (t, g);
+			}
+		} else {
+			struct rb_elem *u = g->left;
+
+			if (is_red (u)) {
+				p->red = u->red = false;
+				g->red = true;
+				e = g;
+			} else {
+				if (e == p->left) {
+					rotate_right (t, p);
+					e = p;
+					p = e->parent;
+				}
+				p->red = false;
+				g->red = true;
+				rotate_left (t, g);
+			}
+		}
+	}
+	t->root->red = false;
+}
+
+/* Restores the red-black properties of T after a black node was
+   removed.  X, possibly null, is the node that took its place
+   and PARENT is X's parent, which is needed when X is null. */
+static void
+remove_fixup (struct rb_tree *t, struct rb_elem *x, struct rb_elem *parent) {
+	while (x != t->root && !is_red (x)) {
+		/* X's side is one black node short, so X's sibling W
+		   exists. */
+		if (x == parent->left) {
+			struct rb_elem *w = parent->right;
+
+			if (w->red) {
+				w->red = false;
+				parent->red = true;
+				rotate_left (t, parent);
+				w = parent->right;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->right)) {
+					w->left->red = false;
+					w->red = true;
+					rotate_right (t, w);
+					w = parent->right;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->right->red = false;
+				rotate_left (t, parent);
+				x = t->root;
+			}
+		} else {
+			struct rb_elem *w = parent->left;
+
+			if (w->red) {
+				w->red = false;
+				parent->red = true;
+				rotate_right (t, parent);
+				w = parent->left;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->left)) {
+					w->right->red = false;
+					w->red = true;
+					rotate_left (t, w);
+					w = parent->left;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->left->red = false;
+				rotate_right (t, parent);
+				x = t->root;
+			}
+		}
+	}
+	if (x != NULL)
+		x->red = false;
+}
+
+/* Returns the least element in the subtree rooted at E. */
+static struct rb_elem *
+leftmost (struct rb_elem *e) {
+	while (e->left != NULL)
+		e = e->left;
+	return e;
+}
+
+/* Returns the greatest element in the subtree rooted at E. */
+static struct rb_elem *
+rightmost (struct rb_elem *e) {
+	while (e->right != NULL)
+		e = e->right;
+	return e;
+}
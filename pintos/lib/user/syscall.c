@@ -155,6 +155,41 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+int
+msync (void *addr, size_t length) {
+	return syscall2 (SYS_MSYNC, addr, length);
+}
+
+int
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+fault_stats (struct fault_stats *stats) {
+	return syscall1 (SYS_FAULT_STATS, stats);
+}
+
+size_t
+rss_limit (size_t pages) {
+	return syscall1 (SYS_RSS_LIMIT, pages);
+}
+
+int
+mem_usage (struct mem_usage *usage) {
+	return syscall1 (SYS_MEM_USAGE, usage);
+}
+
+int
+oom_adj (int adj) {
+	return syscall1 (SYS_OOM_ADJ, adj);
+}
+
+int
+memmap (pid_t pid, char *buf, size_t size) {
+	return syscall3 (SYS_MEMMAP, pid, buf, size);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
@@ -0,0 +1,134 @@
+/* Checks bitmap_scan() against a bit-at-a-time reference on a
+   1M-bit map and reports how many TSC cycles each takes.
+
+   This is a benchmark rather than a graded test, so it is not
+   listed in tests/threads_TESTS.  Run it by hand with
+   `pintos -- -q run bitmap-scan'. */
+
+#include <bitmap.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "intrinsic.h"
+
+/* Number of bits in the benchmark bitmaps. */
+#define BIT_CNT (1024 * 1024)
+
+/* Number of random queries checked against the reference. */
+#define QUERY_CNT 64
+
+/* Number of scans timed for each scenario. */
+#define SCAN_CNT 8
+
+/* The original bitmap_scan(): tests every candidate start bit
+   by testing every bit of its group. */
+static size_t
+reference_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t bit_cnt = bitmap_size (b);
+
+  if (cnt <= bit_cnt)
+    {
+      size_t last = bit_cnt - cnt;
+      size_t i, j;
+
+      for (i = start; i <= last; i++)
+        {
+          for (j = 0; j < cnt; j++)
+            if (bitmap_test (b, i + j) != value)
+              break;
+          if (j == cnt)
+            return i;
+        }
+    }
+  return BITMAP_ERROR;
+}
+
+/* Fills B with random runs of set and clear bits, each at most
+   MAX_RUN bits long. */
+static void
+randomize (struct bitmap *b, size_t max_run)
+{
+  size_t i = 0;
+  bool value = false;
+
+  while (i < bitmap_size (b))
+    {
+      size_t run = random_ulong () % max_run + 1;
+      if (run > bitmap_size (b) - i)
+        run = bitmap_size (b) - i;
+      bitmap_set_multiple (b, i, run, value);
+      i += run;
+      value = !value;
+    }
+}
+
+/* Times SCAN_CNT scans of B for CNT clear bits with both
+   implementations and prints the average cycles per scan. */
+static void
+time_scans (const char *name, const struct bitmap *b, size_t cnt)
+{
+  uint64_t start, ref_cycles, word_cycles;
+  size_t ref_idx = 0, word_idx = 0;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < SCAN_CNT; i++)
+    ref_idx = reference_scan (b, 0, cnt, false);
+  ref_cycles = (rdtsc () - start) / SCAN_CNT;
+
+  start = rdtsc ();
+  for (i = 0; i < SCAN_CNT; i++)
+    word_idx = bitmap_scan (b, 0, cnt, false);
+  word_cycles = (rdtsc () - start) / SCAN_CNT;
+
+  if (ref_idx != word_idx)
+    fail ("%s: bitmap_scan returned %zu, expected %zu",
+          name, word_idx, ref_idx);
+  msg ("%s: %llu cycles bit-at-a-time, %llu cycles word-at-a-time",
+       name, ref_cycles, word_cycles);
+}
+
+void
+test_bitmap_scan (void)
+{
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  int i;
+
+  if (b == NULL)
+    fail ("bitmap_create (%d) failed", BIT_CNT);
+
+  /* Correctness against the reference on a fragmented map. */
+  random_init (0);
+  randomize (b, 96);
+  for (i = 0; i < QUERY_CNT; i++)
+    {
+      size_t start = random_ulong () % BIT_CNT;
+      size_t cnt = random_ulong () % 128;
+      bool value = random_ulong () % 2;
+      size_t expected = reference_scan (b, start, cnt, value);
+      size_t actual = bitmap_scan (b, start, cnt, value);
+
+      if (expected != actual)
+        fail ("scan (%zu, %zu, %d) returned %zu, expected %zu",
+              start, cnt, value, actual, expected);
+    }
+
+  /* Nearly full pool with one free page at the very end, the
+     worst case for palloc_get_page(). */
+  bitmap_set_all (b, true);
+  bitmap_reset (b, BIT_CNT - 1);
+  time_scans ("full map, last bit free", b, 1);
+
+  /* Nearly full pool with one 64-page hole at the end. */
+  bitmap_set_multiple (b, BIT_CNT - 64, 64, false);
+  time_scans ("full map, 64-bit hole at end", b, 64);
+
+  /* Fragmented free map, looking for a large extent. */
+  randomize (b, 32);
+  bitmap_set_multiple (b, BIT_CNT - 256, 256, false);
+  time_scans ("fragmented map, 256-bit extent", b, 256);
+
+  bitmap_destroy (b);
+  pass ();
+}
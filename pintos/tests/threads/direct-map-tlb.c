@@ -0,0 +1,70 @@
+/* Touches one word in each page of a large kernel buffer in a
+   random order, which takes a TLB miss on nearly every access
+   when the kernel direct map is built from 4 kB pages, and
+   reports the average cost of an access in TSC cycles.
+
+   This is a benchmark rather than a graded test, so it is not
+   listed in tests/threads_TESTS.  Run it by hand with
+   `pintos -- -q run direct-map-tlb'. */
+
+#include <random.h>
+#include <stdint.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Largest buffer to try, in pages (32 MB). */
+#define MAX_PAGES 8192
+
+/* Number of passes over the buffer. */
+#define PASS_CNT 8
+
+void
+test_direct_map_tlb (void)
+{
+  size_t page_cnt, i;
+  size_t *order;
+  uint8_t *buf;
+  uint64_t start, cycles;
+  unsigned sum = 0;
+  int round;
+
+  /* Get the largest contiguous buffer we can. */
+  for (page_cnt = MAX_PAGES; page_cnt > 0; page_cnt /= 2)
+    if ((buf = palloc_get_multiple (0, page_cnt)) != NULL)
+      break;
+  if (page_cnt == 0)
+    fail ("could not allocate a buffer");
+
+  order = malloc (page_cnt * sizeof *order);
+  if (order == NULL)
+    fail ("could not allocate the access order");
+
+  /* Visit the pages in a random order so that the hardware
+     prefetchers cannot hide the page walks. */
+  random_init (0);
+  for (i = 0; i < page_cnt; i++)
+    order[i] = i;
+  for (i = page_cnt - 1; i > 0; i--)
+    {
+      size_t j = random_ulong () % (i + 1);
+      size_t t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+
+  start = rdtsc ();
+  for (round = 0; round < PASS_CNT; round++)
+    for (i = 0; i < page_cnt; i++)
+      sum += buf[order[i] * PGSIZE + (round * 64) % PGSIZE];
+  cycles = rdtsc () - start;
+
+  msg ("%zu pages, %llu cycles per access (checksum %u)",
+       page_cnt, cycles / (PASS_CNT * page_cnt), sum);
+
+  free (order);
+  palloc_free_multiple (buf, page_cnt);
+  pass ();
+}
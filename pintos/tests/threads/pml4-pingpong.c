@@ -0,0 +1,121 @@
+/* Two kernel threads, each running on its own user page table
+   with a small working set, hand control back and forth through
+   a pair of semaphores and touch their working set on every
+   turn.  This is the pattern of two processes talking over a
+   pipe.  Reports the average round trip in TSC cycles, which
+   includes two address-space switches and the TLB misses that
+   follow them.
+
+   This is a benchmark rather than a graded test, so it is not
+   listed in tests/threads_TESTS.  Run it by hand with
+   `pintos -- -q -threads-tests run pml4-pingpong' on a kernel
+   built with USERPROG. */
+
+#include <stdint.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+#ifdef USERPROG
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#endif
+
+/* Pages in each thread's working set. */
+#define PAGE_CNT 64
+
+/* Number of round trips. */
+#define ROUND_CNT 2000
+
+/* Where the working set is mapped in each address space. */
+#define WORKING_SET ((uint8_t *) 0x10000000)
+
+#ifdef USERPROG
+struct player
+  {
+    struct semaphore turn;      /* Up when it is our turn. */
+    struct player *other;       /* The other player. */
+    struct semaphore *done;     /* Up when we are finished. */
+  };
+
+/* Builds a page table with PAGE_CNT user pages at WORKING_SET. */
+static uint64_t *
+make_address_space (void)
+{
+  uint64_t *pml4 = pml4_create ();
+  int i;
+
+  if (pml4 == NULL)
+    fail ("pml4_create failed");
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      void *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (kpage == NULL
+          || !pml4_set_page (pml4, WORKING_SET + i * PGSIZE, kpage, true))
+        fail ("could not map the working set");
+    }
+  return pml4;
+}
+
+static void
+player_thread (void *p_)
+{
+  struct player *p = p_;
+  struct thread *t = thread_current ();
+  uint64_t *pml4 = make_address_space ();
+  int round, i;
+
+  /* Run on our own address space from now on. */
+  t->pml4 = pml4;
+  pml4_activate (pml4);
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      sema_down (&p->turn);
+      for (i = 0; i < PAGE_CNT; i++)
+        WORKING_SET[i * PGSIZE + round % PGSIZE]++;
+      sema_up (&p->other->turn);
+    }
+
+  /* Tear the address space down ourselves; this is not a real
+     process.  pml4_destroy() frees the working set pages. */
+  t->pml4 = NULL;
+  pml4_activate (NULL);
+  pml4_destroy (pml4);
+  sema_up (p->done);
+}
+#endif
+
+void
+test_pml4_pingpong (void)
+{
+#ifdef USERPROG
+  struct player a, b;
+  struct semaphore done;
+  uint64_t start, cycles;
+
+  sema_init (&done, 0);
+  sema_init (&a.turn, 0);
+  sema_init (&b.turn, 0);
+  a.other = &b;
+  b.other = &a;
+  a.done = b.done = &done;
+
+  thread_create ("ping", PRI_DEFAULT, player_thread, &a);
+  thread_create ("pong", PRI_DEFAULT, player_thread, &b);
+
+  start = rdtsc ();
+  sema_up (&a.turn);
+  sema_down (&done);
+  sema_down (&done);
+  cycles = rdtsc () - start;
+
+  msg ("%d round trips, %llu cycles per round trip",
+       ROUND_CNT, cycles / ROUND_CNT);
+  pass ();
+#else
+  msg ("needs a kernel built with USERPROG");
+  pass ();
+#endif
+}
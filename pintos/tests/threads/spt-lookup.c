@@ -0,0 +1,118 @@
+/* Builds supplemental page tables with many large lazily mapped
+   regions and reports what they cost: the memory an SPT needs
+   per GB of mapped address space, and the TSC cycles to resolve
+   a faulting address, both the first time, when the struct page
+   is materialized, and afterward.
+
+   This is a benchmark rather than a graded test, so it is not
+   listed in tests/threads_TESTS.  Run it by hand with
+   `pintos -- -q -threads-tests run spt-lookup' on a kernel built
+   with VM. */
+
+#include <random.h>
+#include <stdint.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+/* Size and spacing of each region. */
+#define REGION_SIZE (1UL << 30)
+#define REGION_STRIDE (2UL << 30)
+
+/* Address of the first region. */
+#define REGION_BASE ((uint8_t *) (4UL << 30))
+
+/* Number of faults timed in each configuration. */
+#define FAULT_CNT 4096
+
+#ifdef VM
+/* Maps CNT regions of REGION_SIZE bytes into SPT. */
+static void
+map_regions (struct supplemental_page_table *spt, int cnt)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct vm_region *r = malloc (sizeof *r);
+      if (r == NULL)
+        fail ("out of memory");
+      r->start = REGION_BASE + i * REGION_STRIDE;
+      r->end = r->start + REGION_SIZE;
+      r->type = VM_ANON;
+      r->writable = true;
+      r->file = NULL;
+      r->offset = 0;
+      r->read_bytes = 0;
+      if (!spt_insert_region (spt, r))
+        fail ("spt_insert_region failed");
+    }
+}
+
+/* Returns a random page-aligned address in one of CNT regions. */
+static void *
+random_page (int cnt)
+{
+  return REGION_BASE + random_ulong () % cnt * REGION_STRIDE
+         + random_ulong () % (REGION_SIZE / PGSIZE) * PGSIZE;
+}
+
+/* Times FAULT_CNT lookups of random addresses in an SPT of
+   REGION_CNT regions. */
+static void
+time_lookups (int region_cnt)
+{
+  struct supplemental_page_table spt;
+  static void *addrs[FAULT_CNT];
+  uint64_t start, first, again;
+  int i;
+
+  supplemental_page_table_init (&spt);
+  map_regions (&spt, region_cnt);
+  for (i = 0; i < FAULT_CNT; i++)
+    addrs[i] = random_page (region_cnt);
+
+  start = rdtsc ();
+  for (i = 0; i < FAULT_CNT; i++)
+    if (spt_get_page (&spt, addrs[i]) == NULL)
+      fail ("no page at %p", addrs[i]);
+  first = (rdtsc () - start) / FAULT_CNT;
+
+  start = rdtsc ();
+  for (i = 0; i < FAULT_CNT; i++)
+    if (spt_get_page (&spt, addrs[i]) == NULL)
+      fail ("no page at %p", addrs[i]);
+  again = (rdtsc () - start) / FAULT_CNT;
+
+  msg ("%4d regions: %llu cycles first fault, %llu cycles after",
+       region_cnt, first, again);
+  supplemental_page_table_kill (&spt);
+}
+#endif
+
+void
+test_spt_lookup (void)
+{
+#ifdef VM
+  size_t pages_per_gb = (1UL << 30) / PGSIZE;
+
+  msg ("struct vm_region: %zu bytes, struct page: %zu bytes",
+       sizeof (struct vm_region), sizeof (struct page));
+  msg ("per GB mapped: %zu bytes as a region, %zu bytes as pages",
+       sizeof (struct vm_region), pages_per_gb * sizeof (struct page));
+  msg ("each page touched adds %zu bytes", sizeof (struct page));
+
+  random_init (0);
+  time_lookups (1);
+  time_lookups (16);
+  time_lookups (128);
+  pass ();
+#else
+  msg ("needs a kernel built with VM");
+  pass ();
+#endif
+}
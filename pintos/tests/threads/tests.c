@@ -38,6 +38,10 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"bitmap-scan", test_bitmap_scan},
+    {"direct-map-tlb", test_direct_map_tlb},
+    {"pml4-pingpong", test_pml4_pingpong},
+    {"spt-lookup", test_spt_lookup},
   };
 
 static const char *test_name;
@@ -32,6 +32,10 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_bitmap_scan;
+extern test_func test_direct_map_tlb;
+extern test_func test_pml4_pingpong;
+extern test_func test_spt_lookup;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
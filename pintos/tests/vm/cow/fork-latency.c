@@ -0,0 +1,56 @@
+/* Measures how long fork() takes in a process that has written to
+   the number of megabytes of memory given as its argument (1 by
+   default).  With copy-on-write, fork() shares the parent's frames
+   with the child instead of copying them, so its cost grows with
+   the number of pages mapped rather than with their contents.
+
+   This is a benchmark rather than a graded test, so it is not
+   listed in tests/vm/cow_TESTS.  Run it by hand for each size, e.g.
+   `pintos -m 600 -- -q run "fork-latency 256"'. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Largest size supported, in MB. */
+#define MAX_MB 256
+
+static char buf[MAX_MB << 20];
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t mb = argc > 1 ? atoi (argv[1]) : 1;
+  uint64_t start, cycles;
+  size_t i;
+  pid_t pid;
+
+  test_name = "fork-latency";
+  if (mb > MAX_MB)
+    fail ("at most %d MB", MAX_MB);
+
+  for (i = 0; i < mb << 20; i += 4096)
+    buf[i] = 1;
+
+  start = rdtsc ();
+  pid = fork ("child");
+  if (pid == 0)
+    exit (0);
+  cycles = rdtsc () - start;
+  if (pid < 0)
+    fail ("fork failed");
+  wait (pid);
+
+  msg ("fork of %zu MB process: %llu cycles", mb, cycles);
+  return 0;
+}
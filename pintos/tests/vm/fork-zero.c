@@ -0,0 +1,54 @@
+/* Reads pages of BSS that were never written, which maps them to
+   the shared zero page, and then forks.  The child must see the
+   pages zeroed and get its own copies when it writes them, and the
+   parent's must stay zeroed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 8
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+/* Fails unless every byte of BUF is 0. */
+static void
+check_zero (const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0)
+      fail ("%s: byte %zu is %d, not 0", who, i, buf[i]);
+}
+
+void
+test_main (void)
+{
+  int pid;
+  size_t i;
+
+  check_zero ("before fork");
+  if ((pid = fork ("child")))
+    {
+      int status = wait (pid);
+      msg ("Parent: child exit status is %d", status);
+      check_zero ("parent after fork");
+      for (i = 0; i < PAGE_CNT; i++)
+        buf[i * PAGE_SIZE] = 1;
+      msg ("parent wrote its pages");
+    }
+  else
+    {
+      check_zero ("child");
+      for (i = 0; i < PAGE_CNT; i++)
+        buf[i * PAGE_SIZE] = 2;
+      for (i = 0; i < PAGE_CNT; i++)
+        if (buf[i * PAGE_SIZE] != 2)
+          fail ("child: page %zu lost its write", i);
+      msg ("child wrote its pages");
+      exit (81);
+    }
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-zero) begin
+(fork-zero) child wrote its pages
+child: exit(81)
+(fork-zero) Parent: child exit status is 81
+(fork-zero) parent wrote its pages
+(fork-zero) end
+fork-zero: exit(0)
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Touches the number of megabytes of zeroed memory given as its
+   argument (16 by default) one page at a time, and then reads one
+   byte of each page over and over, so that nearly every access needs
+   a TLB entry of its own.  Prints the cycles each phase takes.  Under
+   the -huge kernel option, the kernel maps aligned 2 MB blocks of
+   such memory with huge pages, which take one fault and one TLB entry
+   instead of 512; compare with a run without it.
+
+   This is a benchmark rather than a graded test, so it is not
+   listed in tests/vm_TESTS.  Run it by hand, e.g.
+   `pintos -m 128 -- -q -huge run "huge-tlb 32"'. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Largest size supported, in MB. */
+#define MAX_MB 64
+
+/* Passes over the memory in the second phase. */
+#define PASSES 16
+
+static char buf[MAX_MB << 20];
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t mb = argc > 1 ? atoi (argv[1]) : 16;
+  size_t size = mb << 20;
+  uint64_t start, touch_cycles, scan_cycles;
+  unsigned sum = 0;
+  size_t i;
+  int pass;
+
+  test_name = "huge-tlb";
+  if (mb == 0 || mb > MAX_MB)
+    fail ("between 1 and %d MB", MAX_MB);
+
+  start = rdtsc ();
+  for (i = 0; i < size; i += 4096)
+    buf[i] = 1;
+  touch_cycles = rdtsc () - start;
+
+  /* Step a little more than a page, so that consecutive reads fall
+     in different pages and different cache sets. */
+  start = rdtsc ();
+  for (pass = 0; pass < PASSES; pass++)
+    for (i = pass * 64 % 4096; i < size; i += 4096 + 64)
+      sum += buf[i];
+  scan_cycles = rdtsc () - start;
+
+  msg ("%zu MB: %llu cycles to touch, %llu cycles to scan %d times",
+       mb, touch_cycles, scan_cycles, PASSES);
+  msg ("checksum %u", sum);
+  return 0;
+}
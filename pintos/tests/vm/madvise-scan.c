@@ -0,0 +1,89 @@
+/* Measures how long it takes to read every page of a file mapping
+   of the number of megabytes given as its argument (4 by default),
+   first without advice, then after madvise() with MADV_SEQUENTIAL,
+   and then with MADV_WILLNEED as well.
+
+   This is a benchmark rather than a graded test, so it is not
+   listed in tests/vm_TESTS.  Run it by hand, e.g.
+   `pintos -- -q run "madvise-scan 16"'. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Largest size supported, in MB. */
+#define MAX_MB 64
+
+/* Where the file is mapped. */
+#define MAP_ADDR ((char *) 0x10000000)
+
+static char block[4096];
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Maps the SIZE bytes of "scan.dat", gives ADVICE1 and then ADVICE2
+   on them unless they are MADV_NORMAL, and reads one byte of each
+   page.  Prints the cycles taken under NAME. */
+static void
+scan (const char *name, size_t size, int advice1, int advice2)
+{
+  uint64_t start, cycles;
+  unsigned sum = 0;
+  int handle;
+  size_t i;
+
+  CHECK ((handle = open ("scan.dat")) > 1, "open \"scan.dat\"");
+  if (mmap (MAP_ADDR, size, 0, handle, 0) == MAP_FAILED)
+    fail ("mmap \"scan.dat\" failed");
+
+  start = rdtsc ();
+  if (advice1 != MADV_NORMAL && madvise (MAP_ADDR, size, advice1) < 0)
+    fail ("madvise failed");
+  if (advice2 != MADV_NORMAL && madvise (MAP_ADDR, size, advice2) < 0)
+    fail ("madvise failed");
+  for (i = 0; i < size; i += sizeof block)
+    sum += MAP_ADDR[i];
+  cycles = rdtsc () - start;
+
+  if (sum != size / sizeof block * 'x')
+    fail ("%s: read back wrong data", name);
+  munmap (MAP_ADDR);
+  close (handle);
+  msg ("%s: %llu cycles", name, cycles);
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t mb = argc > 1 ? atoi (argv[1]) : 4;
+  size_t size = mb << 20;
+  int handle;
+  size_t i;
+
+  test_name = "madvise-scan";
+  if (mb == 0 || mb > MAX_MB)
+    fail ("between 1 and %d MB", MAX_MB);
+
+  for (i = 0; i < sizeof block; i++)
+    block[i] = 'x';
+  CHECK (create ("scan.dat", 0), "create \"scan.dat\"");
+  CHECK ((handle = open ("scan.dat")) > 1, "open \"scan.dat\"");
+  for (i = 0; i < size; i += sizeof block)
+    if (write (handle, block, sizeof block) != sizeof block)
+      fail ("write \"scan.dat\" failed");
+  close (handle);
+
+  scan ("no advice", size, MADV_NORMAL, MADV_NORMAL);
+  scan ("MADV_SEQUENTIAL", size, MADV_SEQUENTIAL, MADV_NORMAL);
+  scan ("MADV_SEQUENTIAL + MADV_WILLNEED", size, MADV_SEQUENTIAL,
+        MADV_WILLNEED);
+  return 0;
+}
@@ -0,0 +1,121 @@
+/* Compares scanning a file of the number of megabytes given as its
+   argument (4 by default) with read() and through a mapping of it,
+   and then with read() while the mapping holds the file's pages in
+   the page cache, where read() finds them.  Also checks that read()
+   sees changes made through the mapping before they are written
+   back.
+
+   This is a benchmark rather than a graded test, so it is not
+   listed in tests/vm_TESTS.  Run it by hand, e.g.
+   `pintos -- -q run "mmap-vs-read 16"'. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Largest size supported, in MB. */
+#define MAX_MB 64
+
+/* Where the file is mapped. */
+#define MAP_ADDR ((char *) 0x10000000)
+
+static char block[4096];
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Sums the SIZE bytes at BUF. */
+static unsigned
+sum_bytes (const char *buf, size_t size)
+{
+  unsigned sum = 0;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    sum += (unsigned char) buf[i];
+  return sum;
+}
+
+/* Reads the SIZE bytes of "scan.dat" with read() and returns their
+   sum.  Prints the cycles taken under NAME. */
+static unsigned
+scan_read (const char *name, size_t size)
+{
+  uint64_t start, cycles;
+  unsigned sum = 0;
+  int handle;
+  size_t i;
+
+  CHECK ((handle = open ("scan.dat")) > 1, "open \"scan.dat\"");
+  start = rdtsc ();
+  for (i = 0; i < size; i += sizeof block)
+    {
+      if (read (handle, block, sizeof block) != sizeof block)
+        fail ("%s: read \"scan.dat\" failed", name);
+      sum += sum_bytes (block, sizeof block);
+    }
+  cycles = rdtsc () - start;
+  close (handle);
+  msg ("%s: %llu cycles", name, cycles);
+  return sum;
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t mb = argc > 1 ? atoi (argv[1]) : 4;
+  size_t size = mb << 20;
+  uint64_t start, cycles;
+  unsigned expected, sum;
+  int handle;
+  size_t i;
+
+  test_name = "mmap-vs-read";
+  if (mb == 0 || mb > MAX_MB)
+    fail ("between 1 and %d MB", MAX_MB);
+
+  for (i = 0; i < sizeof block; i++)
+    block[i] = 'x';
+  CHECK (create ("scan.dat", 0), "create \"scan.dat\"");
+  CHECK ((handle = open ("scan.dat")) > 1, "open \"scan.dat\"");
+  for (i = 0; i < size; i += sizeof block)
+    if (write (handle, block, sizeof block) != sizeof block)
+      fail ("write \"scan.dat\" failed");
+  close (handle);
+
+  /* Sums wrap around alike. */
+  expected = size * 'x';
+  if (scan_read ("read()", size) != expected)
+    fail ("read() read back wrong data");
+
+  CHECK ((handle = open ("scan.dat")) > 1, "open \"scan.dat\"");
+  if (mmap (MAP_ADDR, size, 1, handle, 0) == MAP_FAILED)
+    fail ("mmap \"scan.dat\" failed");
+  start = rdtsc ();
+  sum = sum_bytes (MAP_ADDR, size);
+  cycles = rdtsc () - start;
+  if (sum != expected)
+    fail ("mmap scan read back wrong data");
+  msg ("mmap scan: %llu cycles", cycles);
+
+  if (scan_read ("read() while mapped", size) != expected)
+    fail ("read() while mapped read back wrong data");
+
+  /* Change the first byte of every page through the mapping only. */
+  for (i = 0; i < size; i += sizeof block)
+    MAP_ADDR[i] = 'y';
+  expected += size / sizeof block * ('y' - 'x');
+  if (scan_read ("read() after writes to the mapping", size) != expected)
+    fail ("read() does not see writes to the mapping");
+
+  munmap (MAP_ADDR);
+  close (handle);
+  return 0;
+}
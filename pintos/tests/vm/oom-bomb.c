@@ -0,0 +1,61 @@
+/* Run as "oom-bomb bomb", writes one page after another of a buffer
+   far larger than user memory and swap together, until the kernel
+   runs out of both and kills it with exit status -1.  Run as
+   "oom-bomb good" alongside it, protects itself with oom_adj() and
+   keeps writing and checking a small working set, which must survive
+   the bomb.
+
+   The oom-kill program runs both at once.  To watch the bomb alone,
+   run e.g. `pintos -m 8 --swap-disk=4 -- -q run "oom-bomb bomb"'.
+   It should print "oom-bomb: exit(-1)". */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Pages the bomb writes, more than the kernel can hold. */
+#define BOMB_PAGES (64 * 1024)
+
+/* Working set of the good process, in pages, and passes over it. */
+#define GOOD_PAGES 64
+#define GOOD_PASSES 2000
+
+static char buf[BOMB_PAGES][4096];
+
+static void
+bomb (void)
+{
+  size_t i;
+
+  for (i = 0; i < BOMB_PAGES; i++)
+    buf[i][0] = 1;
+  fail ("bomb: wrote all %d pages without being killed", BOMB_PAGES);
+}
+
+static void
+good (void)
+{
+  size_t i;
+  int pass;
+
+  oom_adj (OOM_ADJ_MIN);
+  for (pass = 0; pass < GOOD_PASSES; pass++)
+    for (i = 0; i < GOOD_PAGES; i++)
+      {
+        if (pass > 0 && buf[i][0] != (char) (i + pass - 1))
+          fail ("good: page %zu corrupted in pass %d", i, pass);
+        buf[i][0] = i + pass;
+      }
+  msg ("good: survived %d passes over %d pages", GOOD_PASSES, GOOD_PAGES);
+}
+
+int
+main (int argc, char *argv[])
+{
+  test_name = "oom-bomb";
+  if (argc > 1 && !strcmp (argv[1], "good"))
+    good ();
+  else
+    bomb ();
+  return 0;
+}
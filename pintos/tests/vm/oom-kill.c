@@ -0,0 +1,34 @@
+/* Runs "oom-bomb good", which protects itself with oom_adj(), and
+   then "oom-bomb bomb", which writes more pages than memory and swap
+   can hold.  The bomb must be killed with exit status -1, and the
+   good process must survive it with its pages intact.
+
+   This needs fork() and exec(), so it is not listed in tests/vm_TESTS.
+   Run it by hand, e.g. `pintos -m 8 --swap-disk=4
+   -p tests/vm/oom-bomb:oom-bomb -- -q run oom-kill'.  It prints "end"
+   if the bomb exited with -1 and the good process with 0. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Forks and runs CMD_LINE, a command line of oom-bomb, in the child. */
+static pid_t
+spawn (const char *cmd_line)
+{
+  pid_t pid = fork ("oom-bomb");
+
+  if (pid == 0 && exec (cmd_line) == -1)
+    fail ("exec \"%s\"", cmd_line);
+  return pid;
+}
+
+void
+test_main (void)
+{
+  pid_t good = spawn ("oom-bomb good");
+  pid_t bomb = spawn ("oom-bomb bomb");
+
+  CHECK (wait (good) == 0, "wait for the good process");
+  CHECK (wait (bomb) == -1, "wait for the bomb");
+}
@@ -0,0 +1,29 @@
+/* Prints the memory map of the process whose pid is given as its
+   argument, or its own if there is none: each region and each run of
+   pages outside regions, with its page counts.
+
+   This is a tool rather than a graded test, so it is not listed in
+   tests/vm_TESTS.  Run it by hand, e.g.
+   `pintos -- run "huge-tlb 4" run "pmap 3"', without -q, since both
+   run at once until process_wait() waits for them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+static char buf[16 * 4096];
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pid = argc > 1 ? atoi (argv[1]) : -1;
+  int len;
+
+  test_name = "pmap";
+  len = memmap (pid, buf, sizeof buf);
+  if (len < 0)
+    fail ("no process %d", pid);
+  write (STDOUT_FILENO, buf, len < (int) sizeof buf ? len : (int) sizeof buf - 1);
+  return 0;
+}
@@ -0,0 +1,104 @@
+/* Maps a file at addresses 1 GB apart, so that each mapping needs a
+   page directory and a page table of its own, touches each mapping
+   and unmaps them all again, over and over, and reports how many
+   page-table pages the process has before, during and after each
+   round.  Then measures how long it takes to fork, exec a copy of
+   itself that exits at once, and wait for it.
+
+   This is a benchmark rather than a graded test, so it is not
+   listed in tests/vm_TESTS.  Run it by hand, e.g.
+   `pintos -- -q run pt-churn'. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Mappings made in each round. */
+#define MAP_CNT 64
+
+/* Rounds of mapping and unmapping. */
+#define ROUND_CNT 4
+
+/* fork(), exec() and wait() cycles timed. */
+#define EXEC_CNT 16
+
+/* Where mapping I goes. */
+#define MAP_ADDR(I) ((char *) 0x100000000 + (uint64_t) (I) * 0x40000000)
+
+static char block[4096];
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Returns the number of page-table pages of this process. */
+static size_t
+pt_pages (void)
+{
+  struct mem_usage usage;
+
+  if (mem_usage (&usage) < 0)
+    fail ("mem_usage failed");
+  return usage.pt_pages;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint64_t start, cycles;
+  int handle, round, i;
+
+  if (argc > 1 && !strcmp (argv[1], "exit"))
+    return 0;
+  test_name = "pt-churn";
+
+  memset (block, 'x', sizeof block);
+  CHECK (create ("churn.dat", 0), "create \"churn.dat\"");
+  CHECK ((handle = open ("churn.dat")) > 1, "open \"churn.dat\"");
+  if (write (handle, block, sizeof block) != sizeof block)
+    fail ("write \"churn.dat\" failed");
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      size_t before = pt_pages (), during;
+
+      for (i = 0; i < MAP_CNT; i++)
+        {
+          if (mmap (MAP_ADDR (i), sizeof block, 0, handle, 0) == MAP_FAILED)
+            fail ("mmap at %p failed", MAP_ADDR (i));
+          if (*MAP_ADDR (i) != 'x')
+            fail ("mapping at %p read back wrong data", MAP_ADDR (i));
+        }
+      during = pt_pages ();
+      for (i = 0; i < MAP_CNT; i++)
+        munmap (MAP_ADDR (i));
+      msg ("round %d: %zu page-table pages before, %zu with %d mappings, "
+           "%zu after", round, before, during, MAP_CNT, pt_pages ());
+    }
+  close (handle);
+
+  start = rdtsc ();
+  for (i = 0; i < EXEC_CNT; i++)
+    {
+      pid_t pid = fork ("pt-churn");
+
+      if (pid == 0)
+        {
+          exec ("pt-churn exit");
+          fail ("exec \"pt-churn exit\" failed");
+        }
+      if (pid < 0)
+        fail ("fork failed");
+      if (wait (pid) != 0)
+        fail ("child exited with an error");
+    }
+  cycles = rdtsc () - start;
+  msg ("fork, exec and wait: %llu cycles each", cycles / EXEC_CNT);
+  return 0;
+}
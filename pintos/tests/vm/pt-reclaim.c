@@ -0,0 +1,47 @@
+/* Maps a file far above the rest of the address space, where it
+   needs a page directory and a page table of its own, reads it, and
+   unmaps it again.  The page-table pages that the mapping needed must
+   be freed with it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* 256 GB up, in a page directory that nothing else uses. */
+#define MAP_ADDR ((char *) 0x4000000000)
+
+/* Returns the number of page-table pages of this process. */
+static size_t
+pt_pages (void)
+{
+  struct mem_usage usage;
+
+  CHECK (mem_usage (&usage) == 0, "mem_usage");
+  return usage.pt_pages;
+}
+
+void
+test_main (void)
+{
+  size_t before, during, after;
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  before = pt_pages ();
+  CHECK (mmap (MAP_ADDR, 4096, 0, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  if (memcmp (MAP_ADDR, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+  during = pt_pages ();
+  if (during < before + 2)
+    fail ("%zu page-table pages with the mapping, %zu without",
+          during, before);
+  munmap (MAP_ADDR);
+  after = pt_pages ();
+  if (after != before)
+    fail ("%zu page-table pages after munmap, %zu before mmap",
+          after, before);
+  close (handle);
+}
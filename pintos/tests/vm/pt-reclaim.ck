@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pt-reclaim) begin
+(pt-reclaim) open "sample.txt"
+(pt-reclaim) mem_usage
+(pt-reclaim) mmap "sample.txt"
+(pt-reclaim) mem_usage
+(pt-reclaim) mem_usage
+(pt-reclaim) end
+EOF
+pass;
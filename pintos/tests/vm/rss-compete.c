@@ -0,0 +1,81 @@
+/* Writes a working set of PAGES pages over and over under a
+   resident-set limit of LIMIT pages (0 for none), checking each page
+   as it goes, and then prints how long it took and its memory use.
+   Run two copies with different limits at once, in a user pool too
+   small for both, to see the limited one reclaim its own pages
+   instead of pushing the other one's out to swap.
+
+   Given "check" as a third argument, prints nothing, but fails if a
+   limited copy ever had more than LIMIT pages resident or an
+   unlimited one had any of its pages pushed out to swap.  The
+   rss-limit program runs two copies that way.  To watch them by hand,
+   run e.g. `pintos -m 8 --swap-disk=16 -- run "rss-compete 256 1024"
+   run "rss-compete 0 1024"', without -q, since both run at once
+   until process_wait() waits for them. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Largest working set supported, in pages. */
+#define MAX_PAGES 4096
+
+/* Passes over the working set. */
+#define PASSES 8
+
+static char buf[MAX_PAGES][4096];
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t limit = argc > 1 ? atoi (argv[1]) : 256;
+  size_t pages = argc > 2 ? atoi (argv[2]) : 1024;
+  bool check = argc > 3 && !strcmp (argv[3], "check");
+  struct mem_usage usage;
+  uint64_t start, cycles;
+  size_t i;
+  int pass;
+
+  test_name = "rss-compete";
+  if (pages == 0 || pages > MAX_PAGES)
+    fail ("between 1 and %d pages", MAX_PAGES);
+  rss_limit (limit);
+
+  start = rdtsc ();
+  for (pass = 0; pass < PASSES; pass++)
+    for (i = 0; i < pages; i++)
+      {
+        if (pass > 0 && buf[i][i % 4096] != (char) (i + pass - 1))
+          fail ("limit %zu: page %zu corrupted in pass %d", limit, i, pass);
+        buf[i][i % 4096] = i + pass;
+      }
+  cycles = rdtsc () - start;
+
+  if (mem_usage (&usage) != 0)
+    fail ("mem_usage failed");
+  if (check)
+    {
+      if (limit != 0 && usage.rss_peak > limit)
+        fail ("limit %zu: %zu pages resident at peak", limit, usage.rss_peak);
+      if (limit == 0 && usage.swap != 0)
+        fail ("no limit: %zu pages pushed out to swap", usage.swap);
+      return 0;
+    }
+  msg ("limit %zu: %d passes over %zu pages took %llu cycles",
+       limit, PASSES, pages, cycles);
+  msg ("limit %zu: %zu pages resident (peak %zu), %zu swapped, "
+       "%lld reclaimed from itself", limit, usage.rss, usage.rss_peak,
+       usage.swap, usage.reclaim);
+  return 0;
+}
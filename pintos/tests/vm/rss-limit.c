@@ -0,0 +1,37 @@
+/* Runs two copies of rss-compete at once in a user pool too small for
+   both working sets: one with no resident-set limit and 512 pages,
+   and one limited to 256 of its 2048 pages.  The limited one must
+   stay within its limit by reclaiming its own pages, and so must not
+   push any of the other one's pages out to swap.
+
+   This needs fork(), exec() and wait(), so it is not listed in
+   tests/vm_TESTS.  Run it by hand, e.g.
+   `pintos -m 16 --swap-disk=16 -p tests/vm/rss-compete:rss-compete
+   -- -q run rss-limit'.  It prints "end" if both processes exited
+   with status 0. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Forks and runs CMD_LINE, a command line of rss-compete, in the
+   child. */
+static pid_t
+spawn (const char *cmd_line)
+{
+  pid_t pid = fork ("rss-compete");
+
+  if (pid == 0 && exec (cmd_line) == -1)
+    fail ("exec \"%s\"", cmd_line);
+  return pid;
+}
+
+void
+test_main (void)
+{
+  pid_t free_run = spawn ("rss-compete 0 512 check");
+  pid_t limited = spawn ("rss-compete 256 2048 check");
+
+  CHECK (wait (free_run) == 0, "wait for the unlimited process");
+  CHECK (wait (limited) == 0, "wait for the limited process");
+}
@@ -3,6 +3,7 @@
 #include <debug.h>
 #include <limits.h>
 #include <random.h>
+#include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -17,10 +18,12 @@
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/memstat.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -31,6 +34,7 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
@@ -140,31 +144,105 @@ bss_init (void) {
 	memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* CPUID 0x80000001 EDX bit: 1 GB pages are supported. */
+#define CPUID_EDX_PAGE1GB (1 << 26)
+
+/* Returns the largest page size that can map physical address PA
+ * at kernel virtual address VA in the direct map, given that
+ * physical memory ends at MEM_END and that pages overlapping the
+ * kernel text [TEXT_START, TEXT_END) must be 4 kB so that the text
+ * can be mapped read-only. */
+static uint64_t
+direct_map_page_size (uint64_t pa, uint64_t va, uint64_t mem_end,
+		uint64_t text_start, uint64_t text_end, bool giant_ok) {
+	const uint64_t sizes[] = { GIANT_PGSIZE, HUGE_PGSIZE };
+
+	for (size_t i = 0; i < sizeof sizes / sizeof *sizes; i++) {
+		uint64_t size = sizes[i];
+		if (size == GIANT_PGSIZE && !giant_ok)
+			continue;
+		if (pa % size == 0 && va % size == 0 && mem_end - pa >= size
+				&& (va + size <= text_start || text_end <= va))
+			return size;
+	}
+	return PGSIZE;
+}
+
 /* Populates the page table with the kernel virtual mapping,
  * and then sets up the CPU to use the new page directory.
- * Points base_pml4 to the pml4 it creates. */
+ * Points base_pml4 to the pml4 it creates.
+ *
+ * The direct map uses 2 MB pages, or 1 GB pages where the CPU
+ * supports them and the alignment of LOADER_KERN_BASE allows, so
+ * that it costs few page-table pages and TLB entries.  Only the
+ * 2 MB regions that overlap the kernel text use 4 kB pages, which
+ * keeps the text read-only.  All of it is global, so it stays in
+ * the TLB across address-space switches. */
 static void
 paging_init (uint64_t mem_end) {
 	uint64_t *pml4, *pte;
 	int perm;
+	uint32_t eax, ebx, ecx, edx;
+	bool giant_ok;
+	size_t pgcnt[3] = { 0, 0, 0 };
+	size_t pt_cnt = 0, pd_cnt = 0, pdp_cnt = 0;
+	uint64_t last_pt = -1, last_pd = -1, last_pdp = -1;
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
+	cpuid (0x80000000, &eax, &ebx, &ecx, &edx);
+	giant_ok = eax >= 0x80000001;
+	if (giant_ok) {
+		cpuid (0x80000001, &eax, &ebx, &ecx, &edx);
+		giant_ok = (edx & CPUID_EDX_PAGE1GB) != 0;
+	}
+
 	extern char start, _end_kernel_text;
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	for (uint64_t pa = 0, size; pa < mem_end; pa += size) {
 		uint64_t va = (uint64_t) ptov(pa);
 
-		perm = PTE_P | PTE_W;
-		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
-			perm &= ~PTE_W;
-
-		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
+		size = direct_map_page_size (pa, va, mem_end, (uint64_t) &start,
+				(uint64_t) &_end_kernel_text, giant_ok);
+		perm = PTE_P | PTE_W | PTE_G;
+		if (size == PGSIZE) {
+			if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
+				perm &= ~PTE_W;
+			pte = pml4e_walk (pml4, va, 1);
+		} else {
+			perm |= PTE_PS;
+			pte = pml4e_walk_huge (pml4, va, size, 1);
+		}
+		if (pte != NULL)
 			*pte = pa | perm;
+
+		/* Account for the page-table pages this mapping needs. */
+		pgcnt[size == PGSIZE ? 0 : size == HUGE_PGSIZE ? 1 : 2]++;
+		if (size == PGSIZE && va >> PDXSHIFT != last_pt) {
+			last_pt = va >> PDXSHIFT;
+			pt_cnt++;
+		}
+		if (size != GIANT_PGSIZE && va >> PDPESHIFT != last_pd) {
+			last_pd = va >> PDPESHIFT;
+			pd_cnt++;
+		}
+		if (va >> PML4SHIFT != last_pdp) {
+			last_pdp = va >> PML4SHIFT;
+			pdp_cnt++;
+		}
 	}
 
 	// reload cr3
 	pml4_activate(0);
+	pml4_tlb_init ();
+	pml4_pool_init ();
+
+	printf ("Kernel direct map: %zu 4 kB, %zu 2 MB, %zu 1 GB pages "
+			"in %zu page-table pages (%llu with 4 kB pages only).\n",
+			pgcnt[0], pgcnt[1], pgcnt[2], 1 + pdp_cnt + pd_cnt + pt_cnt,
+			1 + pdp_cnt + ((LOADER_KERN_BASE + mem_end - 1) >> PDPESHIFT)
+			- (LOADER_KERN_BASE >> PDPESHIFT) + 1
+			+ DIV_ROUND_UP (mem_end, HUGE_PGSIZE));
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -221,11 +299,39 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-mstat"))
+			memstat_enabled = true;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-zswap"))
+			zswap_percent = atoi (value);
+		else if (!strcmp (name, "-fa"))
+			vm_fault_around = atoi (value);
+		else if (!strcmp (name, "-huge"))
+			vm_huge_pages = true;
+		else if (!strcmp (name, "-rss"))
+			vm_rss_limit = atoi (value);
+		else if (!strcmp (name, "-flush"))
+			vm_flush_interval = atoi (value);
+		else if (!strcmp (name, "-ksm")) {
+			char *interval = strchr (value, ',');
+
+			vm_ksm_pages = atoi (value);
+			if (interval != NULL)
+				vm_ksm_interval = atoi (interval + 1);
+		}
+		else if (!strcmp (name, "-wm")) {
+			char *high = strchr (value, ',');
+
+			vm_wmark_low = atoi (value);
+			if (high != NULL)
+				vm_wmark_high = atoi (high + 1);
+		}
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -326,8 +432,26 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -mstat             Print kernel memory use by call site.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -zswap=PCT         Compress swapped pages into up to PCT%% of\n"
+			"                     user memory first (default 20, 0 disables).\n"
+			"  -fa=PAGES          Map PAGES pages around a fault on file data\n"
+			"                     (default 8, 0 disables).\n"
+			"  -wm=LOW,HIGH       Reclaim frames in the background from LOW%%\n"
+			"                     up to HIGH%% of user memory free (default 2,4;\n"
+			"                     0 disables).\n"
+			"  -huge              Map aligned 2 MB blocks of zeroed user memory\n"
+			"                     with huge pages (default off).\n"
+			"  -rss=PAGES         Limit the resident set of each program to\n"
+			"                     PAGES pages when it starts (default 0, none).\n"
+			"  -flush=MS          Write back dirty mapped pages every MS ms\n"
+			"                     (default 1000, 0 disables).\n"
+			"  -ksm=PAGES[,MS]    Scan PAGES frames every MS ms (default 20)\n"
+			"                     for identical pages to merge (default off).\n"
 #endif
 			);
 	power_off ();
@@ -359,7 +483,12 @@ print_stats (void) {
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
+	memstat_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
+	pml4_print_stats ();
+#endif
+#ifdef VM
+	vm_print_stats ();
 #endif
 }
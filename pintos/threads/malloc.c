@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/memstat.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +33,12 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   With -mstat, every block starts with a tag recording the
+   requested size and the call site it is charged to (see
+   memstat.c).  Pages obtained for arenas are charged to malloc()
+   itself. */
 
 /* Descriptor. */
 struct desc {
@@ -57,12 +63,20 @@ struct block {
 	struct list_elem free_elem; /* Free list element. */
 };
 
+/* Accounting tag in front of each block, with -mstat. */
+struct tag {
+	size_t size;                /* Requested size in bytes. */
+	memstat_site_t site;        /* Call site charged. */
+};
+
 /* Our set of descriptors. */
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *malloc_at (size_t size, const void *caller);
+static void *alloc_block (size_t size);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -83,6 +97,32 @@ malloc_init (void) {
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) {
+	return malloc_at (size, __builtin_return_address (0));
+}
+
+/* Like malloc(), but charges the block to CALLER if memory
+   accounting is enabled. */
+static void *
+malloc_at (size_t size, const void *caller) {
+	struct tag *t;
+
+	if (!memstat_enabled)
+		return alloc_block (size);
+
+	if (size == 0 || size > SIZE_MAX - sizeof *t)
+		return NULL;
+	t = alloc_block (size + sizeof *t);
+	if (t == NULL)
+		return NULL;
+	t->size = size;
+	t->site = memstat_alloc (caller, size);
+	return t + 1;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes from
+   the descriptors or the page allocator. */
+static void *
+alloc_block (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
@@ -156,7 +196,7 @@ calloc (size_t a, size_t b) {
 		return NULL;
 
 	/* Allocate and zero memory. */
-	p = malloc (size);
+	p = malloc_at (size, __builtin_return_address (0));
 	if (p != NULL)
 		memset (p, 0, size);
 
@@ -166,6 +206,9 @@ calloc (size_t a, size_t b) {
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
 block_size (void *block) {
+	if (memstat_enabled)
+		return ((struct tag *) block - 1)->size;
+
 	struct block *b = block;
 	struct arena *a = block_to_arena (b);
 	struct desc *d = a->desc;
@@ -185,7 +228,7 @@ realloc (void *old_block, size_t new_size) {
 		free (old_block);
 		return NULL;
 	} else {
-		void *new_block = malloc (new_size);
+		void *new_block = malloc_at (new_size, __builtin_return_address (0));
 		if (old_block != NULL && new_block != NULL) {
 			size_t old_size = block_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
@@ -200,6 +243,12 @@ realloc (void *old_block, size_t new_size) {
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) {
+	if (p != NULL && memstat_enabled) {
+		struct tag *t = (struct tag *) p - 1;
+		memstat_free (t->site, t->size);
+		p = t;
+	}
+
 	if (p != NULL) {
 		struct block *b = p;
 		struct arena *a = block_to_arena (b);
@@ -0,0 +1,133 @@
+#include "threads/memstat.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* Kernel memory accounting.
+
+   When the kernel is booted with -mstat, palloc_get_multiple()
+   and malloc() charge every allocation to the address it was
+   called from, and the matching free credits it back.  Each call
+   site keeps the bytes it currently holds, the most it ever held
+   and how many allocations it made.  power_off() prints the
+   sites holding the most memory, so a leak shows up as a site
+   whose live bytes keep growing instead of as an "out of pages"
+   panic with no culprit.
+
+   Call sites are printed as return addresses; translate them
+   with the `backtrace' tool.
+
+   Without -mstat, the only cost is a test of memstat_enabled in
+   each allocator call. */
+
+/* -mstat: Account kernel memory to the code that allocated it? */
+bool memstat_enabled;
+
+/* Number of call sites tracked.  Site 0 collects allocations from
+   sites that did not fit in the table. */
+#define SITE_CNT 128
+
+/* Number of sites printed by memstat_print_stats(). */
+#define TOP_CNT 10
+
+/* A call site. */
+struct site {
+	const void *caller;         /* Return address of the allocator call. */
+	size_t live;                /* Bytes currently allocated. */
+	size_t peak;                /* Maximum of LIVE. */
+	uint64_t alloc_cnt;         /* Number of allocations. */
+};
+
+/* Call sites, hashed by caller.  Interrupts are disabled while
+   accessing them, because allocation and freeing do not share a
+   lock. */
+static struct site sites[SITE_CNT];
+
+/* Returns the site for CALLER, claiming a free slot for it if it
+   has none, or site 0 if the table is full. */
+static memstat_site_t
+lookup_site (const void *caller) {
+	size_t start = (uintptr_t) caller % (SITE_CNT - 1) + 1;
+	size_t i = start;
+
+	do {
+		if (sites[i].caller == caller)
+			return i;
+		if (sites[i].caller == NULL) {
+			sites[i].caller = caller;
+			return i;
+		}
+		i = i % (SITE_CNT - 1) + 1;
+	} while (i != start);
+	return 0;
+}
+
+/* Charges an allocation of SIZE bytes to CALLER.  Returns the
+   site to pass to memstat_free() when the memory is freed. */
+memstat_site_t
+memstat_alloc (const void *caller, size_t size) {
+	enum intr_level old_level = intr_disable ();
+	memstat_site_t idx = lookup_site (caller);
+	struct site *s = &sites[idx];
+
+	s->alloc_cnt++;
+	s->live += size;
+	if (s->live > s->peak)
+		s->peak = s->live;
+	intr_set_level (old_level);
+	return idx;
+}
+
+/* Credits SIZE freed bytes back to site IDX. */
+void
+memstat_free (memstat_site_t idx, size_t size) {
+	enum intr_level old_level = intr_disable ();
+	struct site *s = &sites[idx];
+
+	ASSERT (s->live >= size);
+	s->live -= size;
+	intr_set_level (old_level);
+}
+
+/* Prints the TOP_CNT sites with the most memory allocated, by
+   peak usage. */
+void
+memstat_print_stats (void) {
+	bool printed[SITE_CNT] = { false };
+	int64_t ticks = timer_ticks ();
+	size_t live = 0;
+
+	if (!memstat_enabled)
+		return;
+
+	for (size_t i = 0; i < SITE_CNT; i++)
+		live += sites[i].live;
+	printf ("Kernel memory: %zu kB live, top call sites by peak:\n",
+			live / 1024);
+	printf ("  %-18s %10s %10s %10s %8s\n",
+			"caller", "live", "peak", "allocs", "allocs/s");
+
+	for (int n = 0; n < TOP_CNT; n++) {
+		struct site *s;
+		size_t best = SITE_CNT;
+
+		for (size_t i = 0; i < SITE_CNT; i++)
+			if (!printed[i] && sites[i].alloc_cnt != 0
+					&& (best == SITE_CNT || sites[i].peak > sites[best].peak))
+				best = i;
+		if (best == SITE_CNT)
+			break;
+		printed[best] = true;
+
+		s = &sites[best];
+		if (s->caller != NULL)
+			printf ("  %#-18"PRIx64, (uint64_t) (uintptr_t) s->caller);
+		else
+			printf ("  %-18s", "(other)");
+		printf (" %10zu %10zu %10"PRIu64" %8"PRIu64"\n",
+				s->live, s->peak, s->alloc_cnt,
+				ticks > 0 ? s->alloc_cnt * TIMER_FREQ / ticks : 0);
+	}
+}
@@ -1,7 +1,9 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
@@ -13,6 +15,9 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
+		/* A 2 MB page: the page directory entry is the leaf. */
+		if ((uint64_t) pte & PTE_P && (uint64_t) pte & PTE_PS)
+			return &pdp[idx];
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
@@ -35,6 +40,9 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 	int allocated = 0;
 	if (pdpe) {
 		uint64_t *pde = (uint64_t *) pdpe[idx];
+		/* A 1 GB page: the page directory pointer entry is the leaf. */
+		if ((uint64_t) pde & PTE_P && (uint64_t) pde & PTE_PS)
+			return &pdpe[idx];
 		if (!((uint64_t) pde & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
@@ -60,7 +68,9 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.
+ * If VADDR is covered by a 2 MB or 1 GB page, the returned entry is
+ * the page directory (pointer) entry with PTE_PS set. */
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	uint64_t *pte = NULL;
@@ -88,13 +98,95 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the next-level table that entry IDX of TABLE points to,
+ * allocating it if it is missing and CREATE is true.  Returns a
+ * null pointer if there is no such table, including when the entry
+ * is itself a large-page leaf. */
+static uint64_t *
+next_table (uint64_t *table, int idx, int create) {
+	if (!(table[idx] & PTE_P)) {
+		uint64_t *new_page;
+		if (!create || (new_page = palloc_get_page (PAL_ZERO)) == NULL)
+			return NULL;
+		table[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+	}
+	if (table[idx] & PTE_PS)
+		return NULL;
+	return ptov (PTE_ADDR (table[idx]));
+}
+
+/* Returns the address of the entry that maps a SIZE-byte page at
+ * virtual address VA in PML4E: the page directory entry if SIZE is
+ * HUGE_PGSIZE, or the page directory pointer entry if SIZE is
+ * GIANT_PGSIZE.  Missing upper-level tables are created if CREATE is
+ * true.  The caller fills in the entry, including PTE_PS.
+ * Returns a null pointer if a table could not be allocated, or if a
+ * larger page already covers VA. */
+uint64_t *
+pml4e_walk_huge (uint64_t *pml4e, const uint64_t va, uint64_t size,
+		int create) {
+	uint64_t *pdpe, *pgdir;
+
+	ASSERT (size == HUGE_PGSIZE || size == GIANT_PGSIZE);
+	ASSERT (va % size == 0);
+
+	pdpe = next_table (pml4e, PML4 (va), create);
+	if (pdpe == NULL)
+		return NULL;
+	if (size == GIANT_PGSIZE)
+		return &pdpe[PDPE (va)];
+	pgdir = next_table (pdpe, PDPE (va), create);
+	if (pgdir == NULL)
+		return NULL;
+	return &pgdir[PDX (va)];
+}
+
+/* Pool of pml4 pages that already hold the kernel half of base_pml4
+ * and no user mappings.  pml4_destroy() puts pages back here instead
+ * of freeing them, up to PML4_POOL_SIZE, so that pml4_create() on
+ * fork and exec skips allocating and copying a page.  Protected by
+ * disabling interrupts. */
+#define PML4_POOL_SIZE 8
+static uint64_t *pml4_pool[PML4_POOL_SIZE];
+static size_t pml4_pool_cnt;
+
+/* Statistics. */
+static long long pml4_create_cnt;     /* pml4_create() calls. */
+static long long pml4_pool_hit_cnt;   /* ...served from pml4_pool. */
+static long long pt_reclaim_cnt;      /* Tables freed by
+                                         pml4_free_tables(). */
+
+/* Fills the pml4 pool.  Must be called once base_pml4 is complete. */
+void
+pml4_pool_init (void) {
+	while (pml4_pool_cnt < PML4_POOL_SIZE) {
+		uint64_t *pml4 = palloc_get_page (0);
+		if (pml4 == NULL)
+			break;
+		memcpy (pml4, base_pml4, PGSIZE);
+		pml4_pool[pml4_pool_cnt++] = pml4;
+	}
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
  * allocation fails. */
 uint64_t *
 pml4_create (void) {
-	uint64_t *pml4 = palloc_get_page (0);
+	enum intr_level old_level = intr_disable ();
+	uint64_t *pml4 = NULL;
+
+	pml4_create_cnt++;
+	if (pml4_pool_cnt > 0) {
+		pml4 = pml4_pool[--pml4_pool_cnt];
+		pml4_pool_hit_cnt++;
+	}
+	intr_set_level (old_level);
+	if (pml4 != NULL)
+		return pml4;
+
+	pml4 = palloc_get_page (0);
 	if (pml4)
 		memcpy (pml4, base_pml4, PGSIZE);
 	return pml4;
@@ -122,7 +214,13 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (pdp[i] & PTE_P && pdp[i] & PTE_PS) {
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
+				return false;
+		} else if (((uint64_t) pte) & PTE_P)
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -135,7 +233,12 @@ pdp_for_each (uint64_t *pdp,
 		pte_for_each_func *func, void *aux, unsigned pml4_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pde = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pde) & PTE_P)
+		if (pdp[i] & PTE_P && pdp[i] & PTE_PS) {
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) i << PDPESHIFT));
+			if (!func (&pdp[i], va, aux))
+				return false;
+		} else if (((uint64_t) pde) & PTE_P)
 			if (!pgdir_for_each ((uint64_t *) PTE_ADDR (pde), func,
 					 aux, pml4_index, i))
 				return false;
@@ -143,7 +246,9 @@ pdp_for_each (uint64_t *pdp,
 	return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each available pte entries including kernel's.
+ * Large-page leaves are passed as their page directory (pointer)
+ * entry, with PTE_PS set. */
 bool
 pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
@@ -155,6 +260,78 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	return true;
 }
 
+/* Control register bits for TLB management. */
+#define CR4_PGE (1UL << 7)          /* Honor PTE_G. */
+#define CR4_PCIDE (1UL << 17)       /* Tag TLB entries with CR3[11:0]. */
+#define CR3_NOFLUSH (1UL << 63)     /* Keep the new PCID's TLB entries. */
+#define CPUID_ECX_PCID (1 << 17)    /* CPUID.1:ECX, PCIDs supported. */
+
+/* Process-context identifiers.
+ * With PCIDs the TLB tags every entry with the PCID that was in CR3
+ * when it was loaded, so switching between address spaces does not
+ * have to throw away the TLB.  PCID 0 belongs to base_pml4.  The
+ * others are lent to user pml4s when they are activated and taken
+ * back round-robin when they run out.  A pml4 whose PCID was taken
+ * away, or whose PTEs changed while it was not active, flushes its
+ * PCID when it is next activated. */
+#define PCID_CNT 32
+static bool pcid_enabled;
+static uint64_t *pcid_owner[PCID_CNT];  /* Owning pml4, null if free. */
+static bool pcid_stale[PCID_CNT];       /* Flush on next activation? */
+static unsigned pcid_victim = 1;        /* Next PCID to take back. */
+
+/* Enables global pages, which keep the kernel's PTE_G mappings in
+ * the TLB across CR3 loads, and PCIDs if the CPU supports them.
+ * Must be called with base_pml4 active. */
+void
+pml4_tlb_init (void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	ASSERT (PTE_ADDR (rcr3 ()) == vtop (base_pml4));
+
+	/* Toggling PGE flushes the whole TLB, including the boot page
+	 * tables' global entries. */
+	lcr4 (rcr4 () | CR4_PGE);
+
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	if (ecx & CPUID_ECX_PCID) {
+		lcr4 (rcr4 () | CR4_PCIDE);
+		pcid_enabled = true;
+	}
+}
+
+/* Returns the PCID owned by PML4, or 0 if it owns none. */
+static unsigned
+pcid_lookup (const uint64_t *pml4) {
+	for (unsigned i = 1; i < PCID_CNT; i++)
+		if (pcid_owner[i] == pml4)
+			return i;
+	return 0;
+}
+
+/* Returns true if PML4 is the page table the CPU is using. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Makes sure the TLB holds no stale translation for VA in PML4 after
+ * its PTE was changed.  For the active pml4 this is a single invlpg.
+ * An inactive pml4 may still have entries cached under its PCID, so
+ * they are flushed when it is next activated. */
+static void
+tlb_invalidate (uint64_t *pml4, const void *va) {
+	if (pml4_is_active (pml4))
+		invlpg ((uint64_t) va);
+	else if (pcid_enabled) {
+		enum intr_level old_level = intr_disable ();
+		unsigned pcid = pcid_lookup (pml4);
+		if (pcid != 0)
+			pcid_stale[pcid] = true;
+		intr_set_level (old_level);
+	}
+}
+
 static void
 pt_destroy (uint64_t *pt) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
@@ -169,7 +346,7 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (((uint64_t) pte) & PTE_P && !(pdp[i] & PTE_PS))
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -179,7 +356,7 @@ static void
 pdpe_destroy (uint64_t *pdpe) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pde = ptov((uint64_t *) pdpe[i]);
-		if (((uint64_t) pde) & PTE_P)
+		if (((uint64_t) pde) & PTE_P && !(pdpe[i] & PTE_PS))
 			pgdir_destroy ((void *) PTE_ADDR (pde));
 	}
 	palloc_free_page ((void *) pdpe);
@@ -192,18 +369,173 @@ pml4_destroy (uint64_t *pml4) {
 		return;
 	ASSERT (pml4 != base_pml4);
 
+	/* Every user mapping goes away, so flush PML4's whole TLB context
+	 * once before its frames return to the allocator instead of
+	 * invalidating page by page. */
+	struct mmu_gather tlb;
+	mmu_gather_init (&tlb, pml4);
+	tlb.flush_all = true;
+	mmu_gather_finish (&tlb);
+
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
-	palloc_free_page ((void *) pml4);
+	pml4[0] = 0;
+
+	/* Give back the PCID, so that a new pml4 allocated in the same
+	 * page does not inherit its TLB entries. */
+	enum intr_level old_level = intr_disable ();
+	if (pcid_enabled) {
+		unsigned pcid = pcid_lookup (pml4);
+		if (pcid != 0)
+			pcid_owner[pcid] = NULL;
+	}
+	/* With the user half gone, what is left is base_pml4's kernel
+	 * half, ready for the next pml4_create(). */
+	if (pml4_pool_cnt < PML4_POOL_SIZE) {
+		pml4_pool[pml4_pool_cnt++] = pml4;
+		pml4 = NULL;
+	}
+	intr_set_level (old_level);
+	if (pml4 != NULL)
+		palloc_free_page ((void *) pml4);
+}
+
+/* Clears the entries of TABLE that map user addresses between START
+ * and END, where TABLE is a page table if LEVEL is 0, a page
+ * directory if it is 1 and a page directory pointer table if it is 2,
+ * and its first entry maps BASE.  Tables below it that this leaves
+ * empty are freed.  Returns true if TABLE is left empty. */
+static bool
+table_free_range (uint64_t *table, int level, uint64_t base,
+		uint64_t start, uint64_t end) {
+	uint64_t span = (uint64_t) PGSIZE << (9 * level);
+	bool empty = true;
+
+	for (unsigned i = 0; i < PGSIZE / sizeof *table; i++) {
+		uint64_t lo = base + i * span;
+
+		if (table[i] != 0 && lo < end && lo + span > start) {
+			if (level > 0 && (table[i] & PTE_P) && !(table[i] & PTE_PS)) {
+				uint64_t *next = ptov (PTE_ADDR (table[i]));
+
+				if (table_free_range (next, level - 1, lo, start, end)) {
+					palloc_free_page (next);
+					pt_reclaim_cnt++;
+					table[i] = 0;
+				}
+			} else if (start <= lo && lo + span <= end)
+				table[i] = 0;
+		}
+		if (table[i] != 0)
+			empty = false;
+	}
+	return empty;
+}
+
+/* Forgets every mapping of user pages between START and END in PML4,
+ * which must no longer be in use, including the accessed and dirty
+ * bits that pml4_clear_page() keeps, and frees the page tables, page
+ * directories and page directory pointer table that this leaves
+ * empty.  Otherwise they would only be freed by pml4_destroy(), and a
+ * process that maps and unmaps all over its address space would
+ * collect empty ones. */
+void
+pml4_free_tables (uint64_t *pml4, void *start, void *end) {
+	uint64_t *pdpe;
+	long long freed = pt_reclaim_cnt;
+
+	ASSERT (pg_ofs (start) == 0);
+	ASSERT (is_user_vaddr (start));
+	ASSERT (pml4 != base_pml4);
+
+	/* Only PML4 entry 0 maps user addresses, as in pml4_destroy(). */
+	if (!(pml4[0] & PTE_P))
+		return;
+	pdpe = ptov (PTE_ADDR (pml4[0]));
+	if (table_free_range (pdpe, 2, 0, (uint64_t) start, (uint64_t) end)) {
+		palloc_free_page (pdpe);
+		pt_reclaim_cnt++;
+		pml4[0] = 0;
+	}
+	/* The CPU may cache entries of the freed tables; invlpg drops
+	 * all of those of the current PCID. */
+	if (pt_reclaim_cnt != freed)
+		tlb_invalidate (pml4, start);
+}
+
+/* Returns the number of page-table pages that map the user half of
+ * PML4, not counting PML4 itself. */
+size_t
+pml4_table_cnt (uint64_t *pml4) {
+	uint64_t *pdpe;
+	size_t cnt = 1;
+
+	if (pml4 == NULL || !(pml4[0] & PTE_P))
+		return 0;
+	pdpe = ptov (PTE_ADDR (pml4[0]));
+	for (unsigned i = 0; i < PGSIZE / sizeof *pdpe; i++) {
+		uint64_t *pgdir;
+
+		if (!(pdpe[i] & PTE_P) || (pdpe[i] & PTE_PS))
+			continue;
+		pgdir = ptov (PTE_ADDR (pdpe[i]));
+		cnt++;
+		for (unsigned j = 0; j < PGSIZE / sizeof *pgdir; j++)
+			if ((pgdir[j] & PTE_P) && !(pgdir[j] & PTE_PS))
+				cnt++;
+	}
+	return cnt;
+}
+
+/* Prints statistics on page tables. */
+void
+pml4_print_stats (void) {
+	printf ("Page tables: %lld pml4s created, %lld from the pool; "
+			"%lld empty tables freed on unmap\n", pml4_create_cnt,
+			pml4_pool_hit_cnt, pt_reclaim_cnt);
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.
+ * With PCIDs, the CR3 load keeps PML4's TLB entries when it still
+ * owns a PCID whose entries are up to date, and flushes only that
+ * PCID's entries otherwise.  Kernel mappings are global and survive
+ * either way. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+	unsigned pcid;
+
+	if (!pcid_enabled) {
+		lcr3 (vtop (pml4 ? pml4 : base_pml4));
+		return;
+	}
+	if (pml4 == NULL || pml4 == base_pml4) {
+		/* base_pml4 only has kernel mappings, which never change. */
+		lcr3 (vtop (base_pml4) | CR3_NOFLUSH);
+		return;
+	}
+
+	old_level = intr_disable ();
+	pcid = pcid_lookup (pml4);
+	if (pcid != 0 && !pcid_stale[pcid])
+		lcr3 (vtop (pml4) | pcid | CR3_NOFLUSH);
+	else {
+		if (pcid == 0) {
+			/* Take a free PCID, or take one back from another pml4. */
+			pcid = pcid_lookup (NULL);
+			if (pcid == 0) {
+				pcid = pcid_victim;
+				pcid_victim = pcid_victim % (PCID_CNT - 1) + 1;
+			}
+			pcid_owner[pcid] = pml4;
+		}
+		pcid_stale[pcid] = false;
+		lcr3 (vtop (pml4) | pcid);
+	}
+	intr_set_level (old_level);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -216,8 +548,13 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
-	if (pte && (*pte & PTE_P))
+	if (pte && (*pte & PTE_P)) {
+		/* User pages are never larger than 2 MB. */
+		if (*pte & PTE_PS)
+			return ptov (PTE_ADDR (*pte) & ~(HUGE_PGSIZE - 1))
+				+ ((uint64_t) uaddr & (HUGE_PGSIZE - 1));
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+	}
 	return NULL;
 }
 
@@ -238,11 +575,71 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
-	if (pte)
+	ASSERT (pte == NULL || !(*pte & PTE_PS));
+	if (pte) {
+		bool was_present = (*pte & PTE_P) != 0;
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		if (was_present)
+			tlb_invalidate (pml4, upage);
+	}
 	return pte != NULL;
 }
 
+/* Like pml4_set_page(), but maps the HUGE_PGSIZE bytes at UPAGE to the
+ * physically contiguous HUGE_PGSIZE bytes at KPAGE with one page
+ * directory entry.  Both must be HUGE_PGSIZE aligned, and none of the
+ * 4 kB pages in between may be mapped; a page table left over from
+ * earlier mappings there is freed.
+ * Returns true if successful, false if memory allocation failed. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t *pde;
+
+	ASSERT ((uint64_t) upage % HUGE_PGSIZE == 0);
+	ASSERT (vtop (kpage) % HUGE_PGSIZE == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	pde = pml4e_walk_huge (pml4, (uint64_t) upage, HUGE_PGSIZE, 1);
+	if (pde == NULL)
+		return false;
+	if ((*pde & PTE_P) && !(*pde & PTE_PS)) {
+		uint64_t *pt = ptov (PTE_ADDR (*pde));
+
+		for (unsigned i = 0; i < PGSIZE / sizeof *pt; i++)
+			ASSERT (!(pt[i] & PTE_P));
+		palloc_free_page (pt);
+	}
+	*pde = vtop (kpage) | PTE_P | PTE_PS | (rw ? PTE_W : 0) | PTE_U;
+	/* Drops any cached copy of the old entry. */
+	tlb_invalidate (pml4, upage);
+	return true;
+}
+
+/* Replaces the HUGE_PGSIZE mapping at UPAGE in PML4 by 4 kB mappings
+ * of the same frame, each with the permissions and the accessed and
+ * dirty bits of the large one.  Returns false if no page table could
+ * be allocated, leaving the mapping as it was. */
+bool
+pml4_split_huge_page (uint64_t *pml4, void *upage) {
+	uint64_t *pde, *pt, addr, flags;
+
+	ASSERT ((uint64_t) upage % HUGE_PGSIZE == 0);
+
+	pde = pml4e_walk_huge (pml4, (uint64_t) upage, HUGE_PGSIZE, 0);
+	ASSERT (pde != NULL && (*pde & PTE_PS));
+	pt = palloc_get_page (0);
+	if (pt == NULL)
+		return false;
+	addr = PTE_ADDR (*pde) & ~(HUGE_PGSIZE - 1);
+	flags = *pde & (PTE_P | PTE_W | PTE_U | PTE_A | PTE_D);
+	for (unsigned i = 0; i < PGSIZE / sizeof *pt; i++)
+		pt[i] = (addr + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	tlb_invalidate (pml4, upage);
+	return true;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
@@ -257,8 +654,38 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_invalidate (pml4, upage);
+	}
+}
+
+/* Marks the N user pages starting at UPAGE "not present" in PML4,
+ * invalidating the TLB once for the whole range.  Pages that are
+ * not mapped are skipped. */
+void
+pml4_clear_range (uint64_t *pml4, void *upage, size_t n) {
+	struct mmu_gather tlb;
+
+	mmu_gather_init (&tlb, pml4);
+	for (size_t i = 0; i < n; i++)
+		mmu_gather_clear_page (&tlb, upage + i * PGSIZE);
+	mmu_gather_finish (&tlb);
+}
+
+/* Allows or forbids writes to virtual page UPAGE in PML4, keeping
+ * its other bits.  UPAGE need not be present. */
+void
+pml4_set_writable (uint64_t *pml4, void *upage, bool writable) {
+	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, false);
+
+	if (pte == NULL)
+		return;
+	if (writable)
+		*pte |= PTE_W;
+	else if (*pte & PTE_W) {
+		/* A cached writable entry would let writes through. */
+		*pte &= ~(uint64_t) PTE_W;
+		if (*pte & PTE_P)
+			tlb_invalidate (pml4, upage);
 	}
 }
 
@@ -280,11 +707,12 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 	if (pte) {
 		if (dirty)
 			*pte |= PTE_D;
-		else
+		else if (*pte & PTE_D) {
+			/* A cached entry that is already dirty would let the CPU
+			 * write the page without setting D again. */
 			*pte &= ~(uint32_t) PTE_D;
-
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+			tlb_invalidate (pml4, vpage);
+		}
 	}
 }
 
@@ -306,10 +734,74 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 	if (pte) {
 		if (accessed)
 			*pte |= PTE_A;
-		else
+		else if (*pte & PTE_A) {
+			/* Otherwise accesses through a cached entry would not set
+			 * A again and the page would look idle to eviction. */
 			*pte &= ~(uint32_t) PTE_A;
+			tlb_invalidate (pml4, vpage);
+		}
+	}
+}
+
+/* Starts a batch of PTE changes to PML4.
+ * Changing a PTE through the mmu_gather_*() functions defers the
+ * TLB invalidation to mmu_gather_finish(), which invalidates just
+ * the pages that changed if there are few of them and reloads CR3
+ * once if there are many.  Frames unmapped in the batch must not
+ * be freed or reused until the batch is finished. */
+void
+mmu_gather_init (struct mmu_gather *tlb, uint64_t *pml4) {
+	ASSERT (pml4 != NULL);
+
+	tlb->pml4 = pml4;
+	tlb->page_cnt = 0;
+	tlb->flush_all = false;
+}
+
+/* Records that the PTE for VA in TLB's pml4 changed. */
+void
+mmu_gather_add (struct mmu_gather *tlb, const void *va) {
+	if (tlb->flush_all)
+		return;
+	if (tlb->page_cnt < MMU_GATHER_MAX)
+		tlb->pages[tlb->page_cnt++] = pg_round_down (va);
+	else
+		tlb->flush_all = true;
+}
+
+/* Like pml4_clear_page(), but as part of batch TLB. */
+void
+mmu_gather_clear_page (struct mmu_gather *tlb, void *upage) {
+	uint64_t *pte;
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (is_user_vaddr (upage));
+
+	pte = pml4e_walk (tlb->pml4, (uint64_t) upage, false);
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+	if (pte != NULL && (*pte & PTE_P) != 0) {
+		*pte &= ~PTE_P;
+		mmu_gather_add (tlb, upage);
 	}
 }
+
+/* Makes the TLB consistent with every PTE changed in batch TLB. */
+void
+mmu_gather_finish (struct mmu_gather *tlb) {
+	if (tlb->page_cnt == 0 && !tlb->flush_all)
+		return;
+
+	if (!pml4_is_active (tlb->pml4))
+		/* Any PCID the pml4 owns is flushed on its next activation,
+		 * however many pages changed. */
+		tlb_invalidate (tlb->pml4, NULL);
+	else if (tlb->flush_all)
+		/* Reloading CR3 without CR3_NOFLUSH drops every non-global
+		 * entry of the current PCID and leaves kernel mappings. */
+		lcr3 (rcr3 () & ~CR3_NOFLUSH);
+	else
+		for (size_t i = 0; i < tlb->page_cnt; i++)
+			invlpg ((uint64_t) tlb->pages[i]);
+
+	tlb->page_cnt = 0;
+	tlb->flush_all = false;
+}
@@ -8,7 +8,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/memstat.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -31,6 +33,9 @@ struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	memstat_site_t *site_map;       /* Allocating call site of each page,
+	                                   with -mstat. */
+	size_t free_cnt;                /* Number of free pages. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -42,6 +47,11 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void *get_pages (enum palloc_flags, size_t page_cnt, size_t align,
+		const void *caller);
+static size_t scan_aligned (const struct pool *, size_t page_cnt,
+		size_t align);
+static void add_free (struct pool *, size_t page_cnt, bool freed);
 
 /* multiboot info */
 struct multiboot_info {
@@ -224,11 +234,13 @@ split:
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				pool->free_cnt += page_cnt;
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				pool->free_cnt += page_cnt;
 			}
 		}
 	}
@@ -261,18 +273,63 @@ palloc_init (void) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
+	return get_pages (flags, page_cnt, 1, __builtin_return_address (0));
+}
+
+/* Like palloc_get_multiple(), but the physical address of the first
+   page is a multiple of ALIGN pages, which must be a power of 2.
+   Used for frames that back 2 MB user pages. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align) {
+	ASSERT (align != 0 && (align & (align - 1)) == 0);
+	return get_pages (flags, page_cnt, align, __builtin_return_address (0));
+}
+
+/* Obtains a single free page and returns its kernel virtual
+   address.
+   If PAL_USER is set, the page is obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the page is filled with zeros.  If no pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics. */
+void *
+palloc_get_page (enum palloc_flags flags) {
+	return get_pages (flags, 1, 1, __builtin_return_address (0));
+}
+
+/* Does the work of palloc_get_multiple() and palloc_get_aligned(),
+   charging the pages to CALLER if memory accounting is enabled. */
+static void *
+get_pages (enum palloc_flags flags, size_t page_cnt, size_t align,
+		const void *caller) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t page_idx;
 
 	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	if (align == 1)
+		page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	else {
+		page_idx = scan_aligned (pool, page_cnt, align);
+		if (page_idx != BITMAP_ERROR)
+			bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	}
 	lock_release (&pool->lock);
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
+	if (page_idx != BITMAP_ERROR) {
 		pages = pool->base + PGSIZE * page_idx;
-	else
+		add_free (pool, page_cnt, false);
+	} else
 		pages = NULL;
 
+	if (pages != NULL && memstat_enabled) {
+		memstat_site_t site = memstat_alloc (caller, PGSIZE * page_cnt);
+		size_t i;
+
+		for (i = 0; i < page_cnt; i++)
+			pool->site_map[page_idx + i] = site;
+	}
+
 	if (pages) {
 		if (flags & PAL_ZERO)
 			memset (pages, 0, PGSIZE * page_cnt);
@@ -284,16 +341,26 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	return pages;
 }
 
-/* Obtains a single free page and returns its kernel virtual
-   address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the page is filled with zeros.  If no pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void *
-palloc_get_page (enum palloc_flags flags) {
-	return palloc_get_multiple (flags, 1);
+/* Returns the index of the first run of PAGE_CNT free pages in POOL
+   whose physical address is a multiple of ALIGN pages, or
+   BITMAP_ERROR if there is none.  Kernel virtual addresses are
+   physical addresses plus KERN_BASE, which is aligned much more
+   than that, so page numbers can be compared directly.  Must be
+   called with POOL's lock held. */
+static size_t
+scan_aligned (const struct pool *pool, size_t page_cnt, size_t align) {
+	size_t base = pg_no (pool->base);
+	size_t idx = ROUND_UP (base, align) - base;
+
+	while (idx < bitmap_size (pool->used_map)) {
+		size_t found = bitmap_scan (pool->used_map, idx, page_cnt, false);
+
+		if (found == BITMAP_ERROR || found == idx)
+			return found;
+		/* Try the first aligned start at or after the free run. */
+		idx = ROUND_UP (base + found, align) - base;
+	}
+	return BITMAP_ERROR;
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
@@ -319,7 +386,14 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+	if (memstat_enabled) {
+		size_t i;
+
+		for (i = 0; i < page_cnt; i++)
+			memstat_free (pool->site_map[page_idx + i], PGSIZE);
+	}
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	add_free (pool, page_cnt, true);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +402,32 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void) {
+	return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void) {
+	return user_pool.free_cnt;
+}
+
+/* Adds PAGE_CNT pages to POOL's free count if FREED, otherwise
+   takes them away.  Pages are freed without the pool lock, even
+   from the scheduler, so interrupts are turned off instead. */
+static void
+add_free (struct pool *pool, size_t page_cnt, bool freed) {
+	enum intr_level old_level = intr_disable ();
+
+	if (freed)
+		pool->free_cnt += page_cnt;
+	else
+		pool->free_cnt -= page_cnt;
+	intr_set_level (old_level);
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -345,6 +445,12 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
 	bitmap_set_all(p->used_map, true);
 
 	*bm_base += bm_pages;
+
+	// The call site map follows the bitmap.
+	if (memstat_enabled) {
+		p->site_map = *bm_base;
+		*bm_base += ROUND_UP (pgcnt * sizeof *p->site_map, PGSIZE);
+	}
 }
 
 /* Returns true if PAGE was allocated from POOL,
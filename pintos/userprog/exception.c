@@ -1,7 +1,9 @@
 #include "userprog/exception.h"
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 #include "userprog/gdt.h"
+#include "userprog/process.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "intrinsic.h"
@@ -9,8 +11,17 @@
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Page faults by cause, with how many TSC cycles resolving them
+   took. */
+static struct fault_stats fault_stats;
+static const char *cause_names[FAULT_CAUSE_CNT] = {
+	"file", "zero-fill", "other", "swap-in", "copy-on-write", "minor",
+	"invalid",
+};
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
+static void count_fault (enum fault_cause, uint64_t cycles);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -64,6 +75,37 @@ exception_init (void) {
 void
 exception_print_stats (void) {
 	printf ("Exception: %lld page faults\n", page_fault_cnt);
+	for (int c = 0; c < FAULT_CAUSE_CNT; c++) {
+		long long cnt = fault_stats.count[c];
+
+		if (cnt == 0)
+			continue;
+		printf ("Exception: %lld %s faults, %lld cycles on average; "
+				"by log2 cycles:", cnt, cause_names[c],
+				fault_stats.cycles[c] / cnt);
+		for (int i = 0; i < FAULT_HIST_BUCKETS; i++)
+			if (fault_stats.hist[c][i] != 0)
+				printf (" %d:%lld", i, fault_stats.hist[c][i]);
+		printf ("\n");
+	}
+}
+
+/* Copies the page fault statistics into STATS. */
+void
+exception_get_fault_stats (struct fault_stats *stats) {
+	memcpy (stats, &fault_stats, sizeof *stats);
+}
+
+/* Counts a fault of CAUSE that took CYCLES to resolve. */
+static void
+count_fault (enum fault_cause cause, uint64_t cycles) {
+	int bucket = cycles != 0 ? 63 - __builtin_clzll (cycles) : 0;
+
+	if (bucket >= FAULT_HIST_BUCKETS)
+		bucket = FAULT_HIST_BUCKETS - 1;
+	fault_stats.count[cause]++;
+	fault_stats.cycles[cause] += cycles;
+	fault_stats.hist[cause][bucket]++;
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -86,7 +128,7 @@ kill (struct intr_frame *f) {
 			printf ("%s: dying due to interrupt %#04llx (%s).\n",
 					thread_name (), f->vec_no, intr_name (f->vec_no));
 			intr_dump_frame (f);
-			thread_exit ();
+			process_terminate (-1);
 
 		case SEL_KCSEG:
 			/* Kernel's code segment, which indicates a kernel bug.
@@ -101,7 +143,7 @@ kill (struct intr_frame *f) {
 			   kernel. */
 			printf ("Interrupt %#04llx (%s) in unknown segment %04x\n",
 					f->vec_no, intr_name (f->vec_no), f->cs);
-			thread_exit ();
+			process_terminate (-1);
 	}
 }
 
@@ -122,6 +164,8 @@ page_fault (struct intr_frame *f) {
 	bool write;        /* True: access was write, false: access was read. */
 	bool user;         /* True: access by user, false: access by kernel. */
 	void *fault_addr;  /* Fault address. */
+	enum fault_cause cause = FAULT_INVALID;
+	uint64_t start;
 
 	/* Obtain faulting address, the virtual address that was
 	   accessed to cause the fault.  It may point to code or to
@@ -140,11 +184,21 @@ page_fault (struct intr_frame *f) {
 	write = (f->error_code & PF_W) != 0;
 	user = (f->error_code & PF_U) != 0;
 
+	start = rdtsc ();
 #ifdef VM
 	/* For project 3 and later. */
-	if (vm_try_handle_fault (f, fault_addr, user, write, not_present))
-		return;
+	cause = vm_handle_fault (fault_addr, write, not_present);
 #endif
+	count_fault (cause, rdtsc () - start);
+#ifdef VM
+	/* A process killed for lack of memory exits at its next fault
+	   in user code, whether or not the fault was resolved.  A fault
+	   in the kernel, which may hold locks, is left to finish. */
+	if (user && thread_current ()->oom_killed)
+		process_terminate (-1);
+#endif
+	if (cause != FAULT_INVALID)
+		return;
 
 	/* Count page faults. */
 	page_fault_cnt++;
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "userprog/gdt.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -13,7 +14,9 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
@@ -22,10 +25,29 @@
 #include "vm/vm.h"
 #endif
 
+/* What a parent process and a child share, so that the parent can
+ * wait for the child and get its exit status.  Freed by whichever of
+ * the two is done with it last. */
+struct process_child {
+	tid_t tid;                   /* The child. */
+	int status;                  /* Exit status, once EXITED is up. */
+	struct semaphore exited;     /* Upped when the child exits. */
+	int ref_cnt;                 /* Parent and child, while each cares. */
+	struct list_elem elem;       /* Element in the parent's children. */
+};
+
+/* Passed to initd(). */
+struct initd_aux {
+	char *file_name;             /* Command line, in a page. */
+	struct process_child *child; /* Shared with the parent. */
+};
+
 static void process_cleanup (void);
 static bool load (const char *file_name, struct intr_frame *if_);
-static void initd (void *f_name);
+static void initd (void *aux);
 static void __do_fork (void *);
+static struct process_child *child_create (void);
+static void child_put (struct process_child *child);
 
 /* General process initializer for initd and other process. */
 static void
@@ -40,7 +62,10 @@ process_init (void) {
  * Notice that THIS SHOULD BE CALLED ONCE. */
 tid_t
 process_create_initd (const char *file_name) {
+	struct process_child *child;
+	struct initd_aux *aux;
 	char *fn_copy;
+	char name[sizeof thread_current ()->name];
 	tid_t tid;
 
 	/* Make a copy of FILE_NAME.
@@ -50,18 +75,48 @@ process_create_initd (const char *file_name) {
 		return TID_ERROR;
 	strlcpy (fn_copy, file_name, PGSIZE);
 
-	/* Create a new thread to execute FILE_NAME. */
-	tid = thread_create (file_name, PRI_DEFAULT, initd, fn_copy);
-	if (tid == TID_ERROR)
+	/* The caller may wait for it. */
+	aux = malloc (sizeof *aux);
+	if (aux == NULL) {
 		palloc_free_page (fn_copy);
+		return TID_ERROR;
+	}
+	child = child_create ();
+	if (child == NULL) {
+		free (aux);
+		palloc_free_page (fn_copy);
+		return TID_ERROR;
+	}
+	aux->file_name = fn_copy;
+	aux->child = child;
+
+	/* Create a new thread, named after the program, to execute
+	 * FILE_NAME.  AUX is its own from here on. */
+	strlcpy (name, file_name, sizeof name);
+	name[strcspn (name, " ")] = '\0';
+	tid = thread_create (name, PRI_DEFAULT, initd, aux);
+	if (tid == TID_ERROR) {
+		list_remove (&child->elem);
+		free (child);
+		free (aux);
+		palloc_free_page (fn_copy);
+		return TID_ERROR;
+	}
+	child->tid = tid;
 	return tid;
 }
 
 /* A thread function that launches first user process. */
 static void
-initd (void *f_name) {
+initd (void *aux_) {
+	struct initd_aux *aux = aux_;
+	struct thread *curr = thread_current ();
+	char *f_name = aux->file_name;
+
+	curr->child = aux->child;
+	free (aux);
 #ifdef VM
-	supplemental_page_table_init (&thread_current ()->spt);
+	supplemental_page_table_init (&curr->spt);
 #endif
 
 	process_init ();
@@ -71,6 +126,35 @@ initd (void *f_name) {
 	NOT_REACHED ();
 }
 
+/* Returns a new record of a child process of the current process,
+ * which the child must take over as its CHILD, or NULL if memory runs
+ * out. */
+static struct process_child *
+child_create (void) {
+	struct process_child *child = malloc (sizeof *child);
+
+	if (child == NULL)
+		return NULL;
+	child->tid = TID_ERROR;
+	child->status = -1;
+	sema_init (&child->exited, 0);
+	child->ref_cnt = 2;
+	list_push_back (&thread_current ()->children, &child->elem);
+	return child;
+}
+
+/* Lets go of CHILD, for its parent or for the child itself, and frees
+ * it if the other one has let go of it already. */
+static void
+child_put (struct process_child *child) {
+	enum intr_level old_level = intr_disable ();
+	bool last = --child->ref_cnt == 0;
+
+	intr_set_level (old_level);
+	if (last)
+		free (child);
+}
+
 /* Clones the current process as `name`. Returns the new process's thread id, or
  * TID_ERROR if the thread cannot be created. */
 tid_t
@@ -175,6 +259,9 @@ process_exec (void *f_name) {
 
 	/* We first kill the current context */
 	process_cleanup ();
+#ifdef VM
+	thread_current ()->rss_limit = vm_rss_limit;
+#endif
 
 	/* And then load the binary */
 	success = load (file_name, &_if);
@@ -195,15 +282,27 @@ process_exec (void *f_name) {
  * exception), returns -1.  If TID is invalid or if it was not a
  * child of the calling process, or if process_wait() has already
  * been successfully called for the given TID, returns -1
- * immediately, without waiting.
- *
- * This function will be implemented in problem 2-2.  For now, it
- * does nothing. */
+ * immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) {
-	/* XXX: Hint) The pintos exit if process_wait (initd), we recommend you
-	 * XXX:       to add infinite loop here before
-	 * XXX:       implementing the process_wait. */
+process_wait (tid_t child_tid) {
+	struct list *children = &thread_current ()->children;
+	struct list_elem *e;
+
+	for (e = list_begin (children); e != list_end (children);
+			e = list_next (e)) {
+		struct process_child *child =
+			list_entry (e, struct process_child, elem);
+
+		if (child->tid == child_tid) {
+			int status;
+
+			sema_down (&child->exited);
+			status = child->status;
+			list_remove (&child->elem);
+			child_put (child);
+			return status;
+		}
+	}
 	return -1;
 }
 
@@ -211,12 +310,79 @@ process_wait (tid_t child_tid UNUSED) {
 void
 process_exit (void) {
 	struct thread *curr = thread_current ();
-	/* TODO: Your code goes here.
-	 * TODO: Implement process termination message (see
-	 * TODO: project2/process_termination.html).
-	 * TODO: We recommend you to implement process resource cleanup here. */
 
+	if (curr->pml4 != NULL)
+		printf ("%s: exit(%d)\n", curr->name, curr->exit_status);
 	process_cleanup ();
+	if (curr->fd_table != NULL) {
+		lock_acquire (&filesys_lock);
+		for (int fd = FD_MIN; fd < FD_MAX; fd++)
+			process_close_file (fd);
+		lock_release (&filesys_lock);
+		free (curr->fd_table);
+		curr->fd_table = NULL;
+	}
+
+	/* No one waits for the children now. */
+	while (!list_empty (&curr->children))
+		child_put (list_entry (list_pop_front (&curr->children),
+					struct process_child, elem));
+	if (curr->child != NULL) {
+		curr->child->status = curr->exit_status;
+		sema_up (&curr->child->exited);
+		child_put (curr->child);
+		curr->child = NULL;
+	}
+}
+
+/* Gives FILE the lowest free file descriptor of the current process.
+ * Returns the descriptor, or -1 if all FD_MAX are in use or memory
+ * runs out, in which case FILE is left to the caller. */
+int
+process_add_file (struct file *file) {
+	struct thread *curr = thread_current ();
+
+	if (curr->fd_table == NULL) {
+		curr->fd_table = calloc (FD_MAX, sizeof *curr->fd_table);
+		if (curr->fd_table == NULL)
+			return -1;
+	}
+	for (int fd = FD_MIN; fd < FD_MAX; fd++)
+		if (curr->fd_table[fd] == NULL) {
+			curr->fd_table[fd] = file;
+			return fd;
+		}
+	return -1;
+}
+
+/* Returns the file open as FD in the current process, or NULL if FD is
+ * not an open file. */
+struct file *
+process_get_file (int fd) {
+	struct thread *curr = thread_current ();
+
+	if (curr->fd_table == NULL || fd < FD_MIN || fd >= FD_MAX)
+		return NULL;
+	return curr->fd_table[fd];
+}
+
+/* Closes FD in the current process, if it is open. */
+void
+process_close_file (int fd) {
+	struct file *file = process_get_file (fd);
+
+	if (file != NULL) {
+		thread_current ()->fd_table[fd] = NULL;
+		file_close (file);
+	}
+}
+
+/* Terminates the current process with exit status STATUS, which
+ * process_wait() returns to its parent. */
+void
+process_terminate (int status) {
+	thread_current ()->exit_status = status;
+	thread_exit ();
 }
 
 /* Free the current process's resources. */
@@ -310,13 +476,19 @@ struct ELF64_PHDR {
 #define ELF ELF64_hdr
 #define Phdr ELF64_PHDR
 
+/* Most words on a command line. */
+#define ARG_MAX 64
+
 static bool setup_stack (struct intr_frame *if_);
+static bool push_args (struct intr_frame *if_, int argc, char **argv);
 static bool validate_segment (const struct Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes,
 		bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads an ELF executable into the current thread from the file named
+ * by the first word of the command line FILE_NAME, and passes it all
+ * of the words as its arguments.
  * Stores the executable's entry point into *RIP
  * and its initial stack pointer into *RSP.
  * Returns true if successful, false otherwise. */
@@ -327,8 +499,23 @@ load (const char *file_name, struct intr_frame *if_) {
 	struct file *file = NULL;
 	off_t file_ofs;
 	bool success = false;
+	char *argv[ARG_MAX];
+	char *cmd_line, *token, *save_ptr;
+	int argc = 0;
 	int i;
 
+	/* Split the command line into words. */
+	cmd_line = palloc_get_page (0);
+	if (cmd_line == NULL)
+		return false;
+	strlcpy (cmd_line, file_name, PGSIZE);
+	for (token = strtok_r (cmd_line, " ", &save_ptr);
+			token != NULL && argc < ARG_MAX;
+			token = strtok_r (NULL, " ", &save_ptr))
+		argv[argc++] = token;
+	if (argc == 0)
+		goto done;
+
 	/* Allocate and activate page directory. */
 	t->pml4 = pml4_create ();
 	if (t->pml4 == NULL)
@@ -336,9 +523,9 @@ load (const char *file_name, struct intr_frame *if_) {
 	process_activate (thread_current ());
 
 	/* Open executable file. */
-	file = filesys_open (file_name);
+	file = filesys_open (argv[0]);
 	if (file == NULL) {
-		printf ("load: %s: open failed\n", file_name);
+		printf ("load: %s: open failed\n", argv[0]);
 		goto done;
 	}
 
@@ -414,17 +601,54 @@ load (const char *file_name, struct intr_frame *if_) {
 	/* Start address. */
 	if_->rip = ehdr.e_entry;
 
-	/* TODO: Your code goes here.
-	 * TODO: Implement argument passing (see project2/argument_passing.html). */
+	if (!push_args (if_, argc, argv))
+		goto done;
 
 	success = true;
 
 done:
 	/* We arrive here whether the load is successful or not. */
 	file_close (file);
+	palloc_free_page (cmd_line);
 	return success;
 }
 
+/* Pushes the ARGC words in ARGV onto the user stack set up in IF_,
+ * then ARGV itself, null-terminated, and a fake return address, and
+ * passes ARGC and ARGV to main() in RDI and RSI.  Returns false if
+ * they do not fit in the stack's one page. */
+static bool
+push_args (struct intr_frame *if_, int argc, char **argv) {
+	uint8_t *rsp = (uint8_t *) if_->rsp;
+	uint8_t *limit = (uint8_t *) USER_STACK - PGSIZE;
+	int i;
+
+	/* The words first, with ARGV[] changed to point to the copies. */
+	for (i = argc - 1; i >= 0; i--) {
+		size_t len = strlen (argv[i]) + 1;
+
+		if ((size_t) (rsp - limit) < len)
+			return false;
+		rsp -= len;
+		memcpy (rsp, argv[i], len);
+		argv[i] = (char *) rsp;
+	}
+
+	/* Then ARGV[], word-aligned, and the return address. */
+	rsp = (uint8_t *) ((uintptr_t) rsp & ~(sizeof (char *) - 1));
+	if ((size_t) (rsp - limit) < (argc + 2) * sizeof (char *))
+		return false;
+	rsp -= (argc + 1) * sizeof (char *);
+	memcpy (rsp, argv, argc * sizeof (char *));
+	((char **) rsp)[argc] = NULL;
+	if_->R.rdi = argc;
+	if_->R.rsi = (uint64_t) rsp;
+	rsp -= sizeof (void *);
+	*(void **) rsp = NULL;
+	if_->rsp = (uint64_t) rsp;
+	return true;
+}
+
 
 /* Checks whether PHDR describes a valid, loadable segment in
  * FILE and returns true if so, false otherwise. */
@@ -574,13 +798,6 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -602,23 +819,16 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
-			return false;
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
+	/* The whole segment becomes one private region, whose pages are
+	 * read from the file when they are first touched.  The region
+	 * needs its own handle, because load() closes FILE. */
+	struct file *backing = file_reopen (file);
+	if (backing == NULL)
+		return false;
+	if (!vm_alloc_region (upage, read_bytes + zero_bytes, VM_ANON, writable,
+				backing, ofs, read_bytes)) {
+		file_close (backing);
+		return false;
 	}
 	return true;
 }
@@ -629,11 +839,11 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-
+	if (vm_alloc_page (VM_ANON | VM_MARKER_0, stack_bottom, true)
+			&& vm_claim_page (stack_bottom)) {
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 	return success;
 }
 #endif /* VM */
@@ -1,15 +1,36 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/loader.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
+#include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/process.h"
 #include "threads/flags.h"
 #include "intrinsic.h"
+#ifdef VM
+#include "vm/vm.h"
+#include "vm/memmap.h"
+#endif
 
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
+static bool user_mapped (const void *uaddr, size_t size, bool write);
+static bool user_readable (const void *uaddr, size_t size);
+static bool user_writable (void *uaddr, size_t size);
+static bool user_string (const char *ustr);
+static int sys_open (const char *name);
+static int sys_read (int fd, void *buffer, unsigned size);
+static int sys_write (int fd, const void *buffer, unsigned size);
+
+struct lock filesys_lock;
 
 /* System call.
  *
@@ -35,12 +56,247 @@ syscall_init (void) {
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
+	lock_init (&filesys_lock);
 }
 
 /* The main system call interface */
 void
-syscall_handler (struct intr_frame *f UNUSED) {
-	// TODO: Your implementation goes here.
-	printf ("system call!\n");
-	thread_exit ();
+syscall_handler (struct intr_frame *f) {
+	struct file *file;
+
+	switch (f->R.rax) {
+		case SYS_HALT:
+			power_off ();
+		case SYS_EXIT:
+			process_terminate ((int) f->R.rdi);
+		case SYS_WAIT:
+			f->R.rax = process_wait ((tid_t) f->R.rdi);
+			return;
+		case SYS_CREATE:
+			if (!user_string ((const char *) f->R.rdi))
+				process_terminate (-1);
+			lock_acquire (&filesys_lock);
+			f->R.rax = filesys_create ((const char *) f->R.rdi, f->R.rsi);
+			lock_release (&filesys_lock);
+			return;
+		case SYS_REMOVE:
+			if (!user_string ((const char *) f->R.rdi))
+				process_terminate (-1);
+			lock_acquire (&filesys_lock);
+			f->R.rax = filesys_remove ((const char *) f->R.rdi);
+			lock_release (&filesys_lock);
+			return;
+		case SYS_OPEN:
+			f->R.rax = sys_open ((const char *) f->R.rdi);
+			return;
+		case SYS_FILESIZE:
+			file = process_get_file ((int) f->R.rdi);
+			if (file == NULL) {
+				f->R.rax = -1;
+				return;
+			}
+			lock_acquire (&filesys_lock);
+			f->R.rax = file_length (file);
+			lock_release (&filesys_lock);
+			return;
+		case SYS_READ:
+			f->R.rax = sys_read ((int) f->R.rdi, (void *) f->R.rsi, f->R.rdx);
+			return;
+		case SYS_WRITE:
+			f->R.rax = sys_write ((int) f->R.rdi, (const void *) f->R.rsi,
+					f->R.rdx);
+			return;
+		case SYS_SEEK:
+			file = process_get_file ((int) f->R.rdi);
+			if (file != NULL) {
+				lock_acquire (&filesys_lock);
+				file_seek (file, f->R.rsi);
+				lock_release (&filesys_lock);
+			}
+			return;
+		case SYS_TELL:
+			file = process_get_file ((int) f->R.rdi);
+			if (file == NULL) {
+				f->R.rax = -1;
+				return;
+			}
+			lock_acquire (&filesys_lock);
+			f->R.rax = file_tell (file);
+			lock_release (&filesys_lock);
+			return;
+		case SYS_CLOSE:
+			lock_acquire (&filesys_lock);
+			process_close_file ((int) f->R.rdi);
+			lock_release (&filesys_lock);
+			return;
+#ifdef VM
+		case SYS_MMAP:
+			file = process_get_file ((int) f->R.r10);
+			if (file == NULL) {
+				f->R.rax = (uint64_t) NULL;
+				return;
+			}
+			lock_acquire (&filesys_lock);
+			f->R.rax = (uint64_t) do_mmap ((void *) f->R.rdi, f->R.rsi,
+					f->R.rdx, file, f->R.r8);
+			lock_release (&filesys_lock);
+			return;
+		case SYS_MUNMAP:
+			do_munmap ((void *) f->R.rdi);
+			return;
+		case SYS_MSYNC:
+			f->R.rax = do_msync ((void *) f->R.rdi, f->R.rsi);
+			return;
+		case SYS_MADVISE:
+			f->R.rax = do_madvise ((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+			return;
+		case SYS_RSS_LIMIT:
+			f->R.rax = vm_set_rss_limit (f->R.rdi);
+			return;
+		case SYS_MEM_USAGE:
+			if (!user_writable ((void *) f->R.rdi, sizeof (struct mem_usage))) {
+				f->R.rax = -1;
+				return;
+			}
+			vm_get_mem_usage ((struct mem_usage *) f->R.rdi);
+			f->R.rax = 0;
+			return;
+		case SYS_OOM_ADJ:
+			f->R.rax = vm_set_oom_adj ((int) f->R.rdi);
+			return;
+		case SYS_MEMMAP:
+			if (!user_writable ((void *) f->R.rsi, f->R.rdx)) {
+				f->R.rax = -1;
+				return;
+			}
+			f->R.rax = memmap_get ((tid_t) f->R.rdi, (char *) f->R.rsi, f->R.rdx);
+			return;
+#endif
+		case SYS_FAULT_STATS:
+			if (!user_writable ((void *) f->R.rdi, sizeof (struct fault_stats))) {
+				f->R.rax = -1;
+				return;
+			}
+			exception_get_fault_stats ((struct fault_stats *) f->R.rdi);
+			f->R.rax = 0;
+			return;
+		default:
+			// TODO: Your implementation goes here.
+			printf ("system call!\n");
+			process_terminate (-1);
+	}
+}
+
+/* Opens the file called NAME for the current process.  Returns its
+ * file descriptor, or -1 if it cannot be opened. */
+static int
+sys_open (const char *name) {
+	struct file *file;
+	int fd;
+
+	if (!user_string (name))
+		process_terminate (-1);
+	lock_acquire (&filesys_lock);
+	file = filesys_open (name);
+	fd = file != NULL ? process_add_file (file) : -1;
+	if (file != NULL && fd == -1)
+		file_close (file);
+	lock_release (&filesys_lock);
+	return fd;
+}
+
+/* Reads SIZE bytes from FD into BUFFER, where FD 0 is the keyboard.
+ * Returns the number of bytes read, or -1 if FD is not open. */
+static int
+sys_read (int fd, void *buffer, unsigned size) {
+	struct file *file;
+	int read;
+
+	if (!user_writable (buffer, size))
+		process_terminate (-1);
+	if (fd == 0) {
+		for (unsigned i = 0; i < size; i++)
+			((uint8_t *) buffer)[i] = input_getc ();
+		return size;
+	}
+	file = process_get_file (fd);
+	if (file == NULL)
+		return -1;
+	lock_acquire (&filesys_lock);
+	read = file_read (file, buffer, size);
+	lock_release (&filesys_lock);
+	return read;
+}
+
+/* Writes SIZE bytes from BUFFER to FD, where FD 1 is the console.
+ * Returns the number of bytes written, or -1 if FD is not open. */
+static int
+sys_write (int fd, const void *buffer, unsigned size) {
+	struct file *file;
+	int written;
+
+	if (!user_readable (buffer, size))
+		process_terminate (-1);
+	if (fd == 1) {
+		putbuf (buffer, size);
+		return size;
+	}
+	file = process_get_file (fd);
+	if (file == NULL)
+		return -1;
+	lock_acquire (&filesys_lock);
+	written = file_write (file, buffer, size);
+	lock_release (&filesys_lock);
+	return written;
+}
+
+/* Returns true if the SIZE bytes at UADDR are user memory that the
+ * current process may read, and may also write to if WRITE. */
+static bool
+user_mapped (const void *uaddr, size_t size, bool write) {
+	const void *end = uaddr + size;
+
+	if (end < uaddr || !is_user_vaddr (uaddr)
+			|| (size > 0 && !is_user_vaddr (end - 1)))
+		return false;
+	for (void *va = pg_round_down (uaddr); va < end; va += PGSIZE) {
+#ifdef VM
+		struct page *page = spt_get_page (&thread_current ()->spt, va);
+
+		if (page == NULL || (write && !page->writable))
+			return false;
+#else
+		uint64_t *pte = pml4e_walk (thread_current ()->pml4, (uint64_t) va, 0);
+
+		if (pte == NULL || !(*pte & PTE_P) || (write && !is_writable (pte)))
+			return false;
+#endif
+	}
+	return true;
+}
+
+/* Returns true if the SIZE bytes at UADDR are user memory that the
+ * current process may read. */
+static bool
+user_readable (const void *uaddr, size_t size) {
+	return user_mapped (uaddr, size, false);
+}
+
+/* Returns true if the SIZE bytes at UADDR are user memory that the
+ * current process may write to. */
+static bool
+user_writable (void *uaddr, size_t size) {
+	return user_mapped (uaddr, size, true);
+}
+
+/* Returns true if USTR is a null-terminated string in user memory
+ * that the current process may read. */
+static bool
+user_string (const char *ustr) {
+	for (const char *p = ustr; ; p++) {
+		if ((p == ustr || pg_ofs (p) == 0) && !user_readable (p, 1))
+			return false;
+		if (*p == '\0')
+			return true;
+	}
 }
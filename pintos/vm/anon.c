@@ -1,7 +1,25 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <bitmap.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
 #include "vm/vm.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/zswap.h"
+
+/* Number of sectors in a swap slot. */
+#define SLOT_SECTORS (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Most pages written to swap in one eviction. */
+#define SWAP_CLUSTER 8
+
+/* Most pages read ahead of a swap-in fault. */
+#define SWAP_READAHEAD 7
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +35,384 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Swap slots, one bit per page of swap_disk, and their lock.  A slot
+ * written for a shared frame is shared by the pages that mapped it,
+ * so each slot in use counts the pages whose copy it holds. */
+static struct bitmap *swap_map;
+static unsigned short *slot_refs;
+static struct lock swap_lock;
+
+/* Statistics. */
+static size_t slots_used;         /* Slots in use. */
+static size_t slots_peak;         /* Most slots ever in use at once. */
+static long long write_cnt;       /* Pages written to swap. */
+static long long cluster_cnt;     /* Writes, each of one or more pages. */
+static long long read_cnt;        /* Pages read from swap. */
+static long long readahead_cnt;   /* Pages read ahead of a fault. */
+static long long zero_cnt;        /* Zero pages saved as a flag. */
+static long long zero_hit_cnt;    /* Swap-ins of zero pages. */
+static long long zswap_hit_cnt;   /* Swap-ins from the zswap pool. */
+static long long share_slot_cnt;  /* Copies shared by evicted pages. */
+
+static bool needs_write (const struct page *page);
+static bool cluster_accept (const struct page *first,
+		const struct page *page);
+static void free_slot (struct page *page);
+static void slot_put (size_t slot);
+static void read_copy (struct page *page, void *kva, bool keep);
+static void drop_copy (struct page *page);
+static bool is_zero (const void *kva);
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	lock_init (&swap_lock);
+	if (swap_disk != NULL) {
+		size_t slot_cnt = disk_size (swap_disk) / SLOT_SECTORS;
+
+		swap_map = bitmap_create (slot_cnt);
+		slot_refs = calloc (slot_cnt, sizeof *slot_refs);
+		if (swap_map == NULL || slot_refs == NULL)
+			PANIC ("swap bitmap creation failed");
+	}
+	zswap_init ();
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
+	page->anon.slot = ANON_NO_SLOT;
+	page->anon.zswap = NULL;
+	page->anon.zero = false;
+	page->anon.modified = false;
+	return true;
+}
+
+/* Returns true if PAGE has a saved copy in swap. */
+bool
+anon_is_swapped (const struct page *page) {
+	return page->anon.slot != ANON_NO_SLOT || page->anon.zswap != NULL
+		|| page->anon.zero;
+}
+
+/* Reads the copy of PAGE saved in swap into KVA, leaving the copy
+ * in place. */
+bool
+anon_read_swap (struct page *page, void *kva) {
+	ASSERT (anon_is_swapped (page));
+
+	read_copy (page, kva, true);
+	return true;
+}
+
+/* Writes the page at KVA to a new swap slot for PAGE, which must
+ * have none.  Returns false if swap is full.  Must be called with
+ * swap_lock held. */
+bool
+anon_write_slot (struct page *page, const void *kva) {
+	size_t slot;
 
-	struct anon_page *anon_page = &page->anon;
+	ASSERT (page->anon.slot == ANON_NO_SLOT);
+
+	if (swap_map == NULL
+			|| (slot = bitmap_scan_and_flip (swap_map, 0, 1, false))
+			== BITMAP_ERROR)
+		return false;
+	if (++slots_used > slots_peak)
+		slots_peak = slots_used;
+	for (size_t s = 0; s < SLOT_SECTORS; s++)
+		disk_write (swap_disk, slot * SLOT_SECTORS + s,
+				kva + s * DISK_SECTOR_SIZE);
+	slot_refs[slot] = 1;
+	page->anon.slot = slot;
+	write_cnt++;
+	cluster_cnt++;
+	return true;
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Swap in the page by read contents from the swap disk.
+ * A swap slot or zero flag is kept afterward, so that the page can
+ * be dropped without saving it again if it is evicted before it is
+ * written to.  A zswap entry is freed instead, to give back its
+ * memory. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
-	struct anon_page *anon_page = &page->anon;
+	if (anon_is_swapped (page)) {
+		read_copy (page, kva, false);
+		return true;
+	}
+	if (page->region != NULL && !page->anon.modified)
+		return vm_region_fill (page->region, page->va, kva);
+	memset (kva, 0, PGSIZE);
+	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Brings in the pages that follow PAGE, which has just been read from
+ * swap, as long as they were written out together with it and so sit
+ * in the slots that follow its own. */
+void
+anon_swap_readahead (struct page *page) {
+	struct rb_elem *e = &page->spt_elem;
+	size_t slot = page->anon.slot;
+
+	if (slot == ANON_NO_SLOT
+			|| (page->region != NULL && page->region->advice == MADV_RANDOM))
+		return;
+	for (size_t k = 1; k <= SWAP_READAHEAD; k++) {
+		struct page *next;
+
+		e = rb_next (e);
+		if (e == NULL)
+			break;
+		next = rb_entry (e, struct page, spt_elem);
+		if (next->va != page->va + k * PGSIZE
+				|| next->operations != &anon_ops
+				|| next->region != page->region
+				|| next->frame != NULL
+				|| next->anon.slot != slot + k
+				|| !vm_prefetch_page (next))
+			break;
+		readahead_cnt++;
+	}
+}
+
+/* Swap out the page by writing contents to the swap disk.
+ * A page of zeros is only flagged, and a page that compresses well
+ * goes to the zswap pool instead, unless its frame is shared, since
+ * a zswap entry belongs to one page.  Otherwise, pages that follow PAGE
+ * in its address space and also need writing go out with it, into
+ * the slots that follow its own, so that a later fault can read them
+ * all back in one pass. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	struct page *cluster[SWAP_CLUSTER];
+	uint64_t *pml4 = page->frame->owner->pml4;
+	void *kva = page->frame->kva;
+	struct mmu_gather tlb;
+	size_t base, cnt, n;
+
+	/* Swap or the region already has a copy. */
+	if (!needs_write (page))
+		return true;
+
+	lock_acquire (&swap_lock);
+	drop_copy (page);
+	page->anon.modified = true;
+	if (is_zero (kva)) {
+		page->anon.zero = true;
+		zero_cnt++;
+		lock_release (&swap_lock);
+		return true;
+	}
+	if (page->frame->ref_cnt == 1 && zswap_store (page, kva)) {
+		lock_release (&swap_lock);
+		return true;
+	}
+	lock_release (&swap_lock);
+	if (swap_map == NULL)
+		return false;
+
+	/* Reserve slots for the largest cluster that fits, then unmap
+	 * the neighbors that join it with one TLB flush and give back the
+	 * slots left over. */
+	lock_acquire (&swap_lock);
+	cnt = SWAP_CLUSTER;
+	while ((base = bitmap_scan_and_flip (swap_map, 0, cnt, false))
+			== BITMAP_ERROR && cnt > 1)
+		cnt--;
+	lock_release (&swap_lock);
+	if (base == BITMAP_ERROR)
+		return false;
+
+	mmu_gather_init (&tlb, pml4);
+	n = vm_evict_cluster (page, cluster, cnt, cluster_accept, &tlb);
+	mmu_gather_finish (&tlb);
+
+	lock_acquire (&swap_lock);
+	if (n < cnt)
+		bitmap_set_multiple (swap_map, base + n, cnt - n, false);
+	for (size_t i = 1; i < n; i++) {
+		drop_copy (cluster[i]);
+		cluster[i]->anon.modified = true;
+	}
+	slots_used += n;
+	if (slots_used > slots_peak)
+		slots_peak = slots_used;
+	lock_release (&swap_lock);
+
+	/* The frames are pinned and unmapped, so they hold still while
+	 * frame_lock is released for the writes. */
+	vm_evict_io_begin ();
+	for (size_t i = 0; i < n; i++)
+		for (size_t s = 0; s < SLOT_SECTORS; s++)
+			disk_write (swap_disk, (base + i) * SLOT_SECTORS + s,
+					cluster[i]->frame->kva + s * DISK_SECTOR_SIZE);
+	vm_evict_io_end ();
+
+	for (size_t i = 0; i < n; i++) {
+		struct page *p = cluster[i];
+
+		p->anon.slot = base + i;
+		slot_refs[base + i] = 1;
+		if (i > 0)
+			vm_evict_cluster_done (p);
+	}
+	write_cnt += n;
+	cluster_cnt++;
+	return true;
+}
+
+/* Makes PAGE, which shared a frame with SRC until it was evicted,
+ * share the copy that the swap_out() method of SRC just saved, in
+ * place of any copy of its own. */
+void
+anon_share_copy (struct page *page, const struct page *src) {
+	ASSERT (src->anon.zswap == NULL);
+
+	lock_acquire (&swap_lock);
+	drop_copy (page);
+	page->anon.modified = true;
+	page->anon.zero = src->anon.zero;
+	if (src->anon.slot != ANON_NO_SLOT) {
+		page->anon.slot = src->anon.slot;
+		slot_refs[src->anon.slot]++;
+		share_slot_cnt++;
+	}
+	lock_release (&swap_lock);
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	vm_free_frame (page);
+	if (anon_is_swapped (page)) {
+		lock_acquire (&swap_lock);
+		drop_copy (page);
+		lock_release (&swap_lock);
+	}
+}
+
+/* Prints swap statistics. */
+void
+vm_anon_print_stats (void) {
+	long long hits = zero_hit_cnt + zswap_hit_cnt;
+
+	zswap_print_stats ();
+	printf ("Swap: %lld zero pages, %lld of %lld swap-ins from memory "
+			"(%lld%%)\n", zero_cnt, hits, hits + read_cnt,
+			hits + read_cnt != 0 ? hits * 100 / (hits + read_cnt) : 0);
+	if (swap_map == NULL)
+		return;
+	printf ("Swap: %zu of %zu slots in use (peak %zu), "
+			"%lld pages written in %lld clusters, "
+			"%lld pages read (%lld by readahead), "
+			"%lld slots shared by evicted pages\n",
+			slots_used, bitmap_size (swap_map), slots_peak,
+			write_cnt, cluster_cnt, read_cnt, readahead_cnt, share_slot_cnt);
+}
+
+/* Returns true if resident PAGE, which is the only page that maps
+ * its frame, has no copy elsewhere that it could be brought back
+ * from. */
+static bool
+needs_write (const struct page *page) {
+	return anon_needs_write (page, page->frame->owner->pml4);
+}
+
+/* Returns true if resident PAGE, mapped in PML4, has no copy
+ * elsewhere that it could be brought back from: it was written to
+ * since it was last saved, or it has no copy in swap and no region
+ * that still matches it. */
+bool
+anon_needs_write (const struct page *page, uint64_t *pml4) {
+	return pml4_is_dirty (pml4, page->va)
+		|| (!anon_is_swapped (page)
+			&& (page->region == NULL || page->anon.modified));
+}
+
+/* Returns true if PAGE can be written out in the same cluster as
+ * FIRST, as a predicate for vm_evict_cluster(). */
+static bool
+cluster_accept (const struct page *first, const struct page *page) {
+	return page->operations == &anon_ops && page->region == first->region
+		&& needs_write (page);
+}
+
+/* Reads the copy of PAGE saved in swap into KVA.  A zswap entry is
+ * freed afterward unless KEEP is true.  A swap slot is read without
+ * swap_lock, holding a reference of its own so that the slot is not
+ * reused meanwhile even if every page that shares it lets go. */
+static void
+read_copy (struct page *page, void *kva, bool keep) {
+	size_t slot;
+
+	lock_acquire (&swap_lock);
+	if (page->anon.zswap != NULL) {
+		zswap_load (page, kva, keep);
+		zswap_hit_cnt++;
+		lock_release (&swap_lock);
+		return;
+	}
+	if (page->anon.zero) {
+		memset (kva, 0, PGSIZE);
+		zero_hit_cnt++;
+		lock_release (&swap_lock);
+		return;
+	}
+	slot = page->anon.slot;
+	slot_refs[slot]++;
+	read_cnt++;
+	lock_release (&swap_lock);
+
+	for (size_t s = 0; s < SLOT_SECTORS; s++)
+		disk_read (swap_disk, slot * SLOT_SECTORS + s,
+				kva + s * DISK_SECTOR_SIZE);
+
+	lock_acquire (&swap_lock);
+	slot_put (slot);
+	lock_release (&swap_lock);
+}
+
+/* Discards the copy of PAGE saved in swap, if any.  Must be called
+ * with swap_lock held. */
+static void
+drop_copy (struct page *page) {
+	free_slot (page);
+	zswap_invalidate (page);
+	page->anon.zero = false;
+}
+
+/* Returns true if the page at KVA is all zeros. */
+static bool
+is_zero (const void *kva) {
+	const uint64_t *p = kva;
+
+	for (size_t i = 0; i < PGSIZE / sizeof *p; i++)
+		if (p[i] != 0)
+			return false;
+	return true;
+}
+
+/* Gives back the swap slot of PAGE, if any, once no other page shares
+ * it.  Must be called with swap_lock held. */
+static void
+free_slot (struct page *page) {
+	if (page->anon.slot == ANON_NO_SLOT)
+		return;
+	slot_put (page->anon.slot);
+	page->anon.slot = ANON_NO_SLOT;
+}
+
+/* Drops a reference to SLOT and frees it if that was the last one.
+ * Must be called with swap_lock held. */
+static void
+slot_put (size_t slot) {
+	if (--slot_refs[slot] == 0) {
+		bitmap_reset (swap_map, slot);
+		slots_used--;
+	}
 }
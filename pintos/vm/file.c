@@ -1,10 +1,16 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <stdio.h>
 #include "vm/vm.h"
+#include "devices/timer.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
+static void flusher (void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations file_ops = {
@@ -14,45 +20,162 @@ static const struct page_operations file_ops = {
 	.type = VM_FILE,
 };
 
+/* Milliseconds between writebacks of dirty mapped pages by the flush
+ * thread, or 0 to write them back only on eviction, msync(), munmap()
+ * and exit. */
+unsigned vm_flush_interval = 1000;
+
+/* Statistics. */
+static long long flush_cnt;       /* Pages written by the flush thread. */
+static long long msync_cnt;       /* Pages written by msync(). */
+static long long unmap_cnt;       /* Pages written at munmap or exit. */
+static long long unmap_max;       /* Most pages written by one munmap. */
+
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	if (vm_flush_interval > 0
+			&& thread_create ("flush", PRI_DEFAULT, flusher, NULL) == TID_ERROR)
+		PANIC ("vm_file_init: cannot start flush thread");
+}
+
+/* The flush thread.  Writes back dirty mapped pages periodically, so
+ * that they do not pile up until munmap() or exit and are not lost for
+ * long if the system goes down. */
+static void
+flusher (void *aux UNUSED) {
+	int64_t ticks = (int64_t) vm_flush_interval * TIMER_FREQ / 1000;
+
+	if (ticks < 1)
+		ticks = 1;
+	for (;;) {
+		timer_sleep (ticks);
+		flush_cnt += vm_writeback_all ();
+	}
 }
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &file_ops;
-
-	struct file_page *file_page = &page->file;
+	return true;
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	return vm_region_fill (page->region, page->va, kva);
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.  The frame is
+ * pinned and unmapped, so frame_lock is released for the write. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	vm_evict_io_begin ();
+	file_backed_write_back (page);
+	vm_evict_io_end ();
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	if (vm_file_free_frame (page))
+		unmap_cnt++;
+}
+
+/* Writes PAGE, which must be in memory and be the first page to map
+ * its frame, back to its file if it was changed, and returns true if
+ * it was.  Only the part that came from the file is written, so the
+ * zeros at the end of the last page of a mapping never reach the file,
+ * and a page past the mapped part of the file is not written at all.
+ * The dirty bit is cleared first, so that writes made while the page
+ * is being written out mark it dirty again. */
+bool
+file_backed_write_back (struct page *page) {
+	struct vm_region *region = page->region;
+	uint64_t *pml4 = page->frame->owner->pml4;
+	size_t ofs = page->va - region->start;
+
+	if (pml4 == NULL || !pml4_is_dirty (pml4, page->va))
+		return false;
+	pml4_set_dirty (pml4, page->va, false);
+	if (ofs < region->read_bytes)
+		file_write_at (region->file, page->frame->kva,
+				region->read_bytes - ofs < PGSIZE
+				? region->read_bytes - ofs : PGSIZE, region->offset + ofs);
+	return true;
 }
 
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct file *backing;
+	size_t read_bytes = 0;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || offset < 0
+			|| offset % PGSIZE != 0)
+		return NULL;
+
+	/* The mapping keeps the file open after the caller closes it. */
+	backing = file_reopen (file);
+	if (backing == NULL)
+		return NULL;
+	if (file_length (backing) == 0) {
+		file_close (backing);
+		return NULL;
+	}
+	if (offset < file_length (backing))
+		read_bytes = file_length (backing) - offset;
+	if (read_bytes > length)
+		read_bytes = length;
+
+	if (!vm_alloc_region (addr, length, VM_FILE, writable, backing, offset,
+				read_bytes)) {
+		file_close (backing);
+		return NULL;
+	}
+	return addr;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_region *region = spt_find_region (spt, addr);
+
+	if (region != NULL && region->start == addr
+			&& VM_TYPE (region->type) == VM_FILE) {
+		long long written = unmap_cnt;
+
+		spt_remove_region (spt, region);
+		written = unmap_cnt - written;
+		if (written > unmap_max)
+			unmap_max = written;
+	}
+}
+
+/* Writes back the dirty pages of file mappings in the LENGTH bytes at
+ * ADDR, which must be page-aligned.  Returns 0 on success or -1 if
+ * ADDR is not a valid user address. */
+int
+do_msync (void *addr, size_t length) {
+	void *end = addr + length;
+
+	if (pg_ofs (addr) != 0 || !is_user_vaddr (addr) || end < addr
+			|| (length > 0 && !is_user_vaddr (end - 1)))
+		return -1;
+	msync_cnt += vm_writeback_range (addr, end);
+	return 0;
+}
+
+/* Prints statistics on writing back mapped pages. */
+void
+vm_file_print_stats (void) {
+	printf ("File: %lld pages written back by the flush thread, %lld by "
+			"msync, %lld at munmap or exit (at most %lld in one munmap)\n",
+			flush_cnt, msync_cnt, unmap_cnt, unmap_max);
 }
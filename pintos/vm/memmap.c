@@ -0,0 +1,210 @@
+/* memmap.c: Per-process memory map, like /proc/PID/smaps. */
+
+#include "vm/memmap.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Most bytes of a map formatted at once. */
+#define MEMMAP_MAX (16 * PGSIZE)
+
+/* Page counts of a part of an address space. */
+struct memmap_counts {
+	size_t resident;             /* Pages in memory. */
+	size_t swapped;              /* Pages saved in swap only. */
+	size_t dirty;                /* Resident pages written to. */
+	size_t shared;               /* Resident pages that others map too. */
+};
+
+/* Text being formatted into a buffer of SIZE bytes, of which LEN would
+ * have been written if it were large enough. */
+struct memmap_buf {
+	char *buf;
+	size_t size;
+	size_t len;
+};
+
+/* A thread looked up by find_thread(). */
+struct memmap_find {
+	tid_t tid;
+	struct thread *thread;
+};
+
+static void emit (struct memmap_buf *b, const char *format, ...)
+	PRINTF_FORMAT (2, 3);
+static void find_thread (struct thread *t, void *aux);
+static void count_page (struct thread *t, const struct page *page,
+		struct memmap_counts *c);
+static void emit_range (struct memmap_buf *b, void *start, void *end,
+		bool writable, const char *type, const struct memmap_counts *c);
+static void format_map (struct thread *t, struct memmap_buf *b);
+
+/* Formats the memory map of process TID, or of the current process if
+ * TID is -1, into BUF, which holds SIZE bytes and may be in user
+ * memory.  Each region and each run of pages outside regions gets a
+ * line with its address range, permissions, type and page counts.
+ * Like snprintf(), the text is cut short if it does not fit, but the
+ * full length is returned.  Returns -1 if there is no such thread. */
+int
+memmap_get (tid_t tid, char *buf, size_t size) {
+	struct memmap_find find = { tid, NULL };
+	struct memmap_buf b;
+	enum intr_level old_level;
+
+	if (tid == -1)
+		find.tid = thread_tid ();
+	b.size = size < MEMMAP_MAX ? size : MEMMAP_MAX;
+	b.buf = b.size > 0 ? malloc (b.size) : NULL;
+	b.len = 0;
+	if (b.size > 0 && b.buf == NULL)
+		return -1;
+
+	/* The map is read with interrupts off, so that the thread cannot
+	 * exit, and with frame_lock and the lock of its SPT held, so that
+	 * neither its SPT nor the frame table is halfway through a change.
+	 * The locks are only tried, since sleeping would turn interrupts
+	 * back on; frame_lock comes first, as everywhere else. */
+	for (;;) {
+		old_level = intr_disable ();
+		find.thread = NULL;
+		thread_foreach (find_thread, &find);
+		if (find.thread == NULL)
+			break;
+		if (vm_frame_table_try_lock ()) {
+			if (lock_try_acquire (&find.thread->spt.lock))
+				break;
+			vm_frame_table_unlock ();
+		}
+		intr_set_level (old_level);
+		thread_yield ();
+	}
+	if (find.thread != NULL) {
+		format_map (find.thread, &b);
+		lock_release (&find.thread->spt.lock);
+		vm_frame_table_unlock ();
+	}
+	intr_set_level (old_level);
+
+	/* Copied out afterward, since that may fault. */
+	if (find.thread != NULL && b.size > 0)
+		memcpy (buf, b.buf, b.len < b.size ? b.len + 1 : b.size);
+	free (b.buf);
+	return find.thread != NULL ? (int) b.len : -1;
+}
+
+/* Formats the map of T into B.  Must be called with interrupts off,
+ * holding frame_lock and the lock of the SPT of T. */
+static void
+format_map (struct thread *t, struct memmap_buf *b) {
+	struct supplemental_page_table *spt = &t->spt;
+	struct rb_elem *r = rb_first (&spt->regions);
+	struct rb_elem *p = rb_first (&spt->pages);
+	struct memmap_counts total = { 0, 0, 0, 0 };
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	emit (b, "%-25s %4s %-4s %6s %6s %6s %6s %6s  %s\n", "ADDRESS", "PERM",
+			"TYPE", "SIZE", "RSS", "SWAP", "DIRTY", "SHARED", "FILE");
+	while (r != NULL || p != NULL) {
+		struct vm_region *region = r != NULL
+			? rb_entry (r, struct vm_region, elem) : NULL;
+		struct page *page = p != NULL
+			? rb_entry (p, struct page, spt_elem) : NULL;
+		struct memmap_counts c = { 0, 0, 0, 0 };
+
+		if (page != NULL && (region == NULL || page->va < region->start)) {
+			/* A run of pages outside any region, such as the stack. */
+			void *start = page->va, *end;
+			bool writable = page->writable;
+
+			do {
+				count_page (t, page, &c);
+				end = page->va + (page->huge ? HUGE_PGSIZE : PGSIZE);
+				p = rb_next (p);
+				page = p != NULL ? rb_entry (p, struct page, spt_elem) : NULL;
+			} while (page != NULL && page->va == end
+					&& page->writable == writable
+					&& (region == NULL || page->va < region->start));
+			emit_range (b, start, end, writable, "anon", &c);
+			emit (b, "\n");
+		} else {
+			while (page != NULL && page->va < region->end) {
+				count_page (t, page, &c);
+				p = rb_next (p);
+				page = p != NULL ? rb_entry (p, struct page, spt_elem) : NULL;
+			}
+			emit_range (b, region->start, region->end, region->writable,
+					region->type == VM_FILE ? "file"
+					: region->file != NULL ? "priv" : "anon", &c);
+			if (region->file != NULL)
+				emit (b, "  inode %u @%d",
+						(unsigned) inode_get_inumber (file_get_inode (region->file)),
+						(int) region->offset);
+			emit (b, "\n");
+			r = rb_next (r);
+		}
+		total.resident += c.resident;
+		total.swapped += c.swapped;
+		total.dirty += c.dirty;
+		total.shared += c.shared;
+	}
+	emit (b, "total: %zu resident (peak %zu, limit %zu), %zu swapped, "
+			"%zu dirty, %zu shared\n", total.resident, t->rss_peak,
+			t->rss_limit, total.swapped, total.dirty, total.shared);
+}
+
+/* Adds PAGE of T to the counts in C. */
+static void
+count_page (struct thread *t, const struct page *page,
+		struct memmap_counts *c) {
+	size_t n = page->huge ? HUGE_PAGE_CNT : 1;
+
+	if (page->frame != NULL) {
+		c->resident += n;
+		if (page->frame->ref_cnt > 1 || vm_is_zero_frame (page->frame))
+			c->shared += n;
+		if (t->pml4 != NULL && pml4_is_dirty (t->pml4, page->va))
+			c->dirty += n;
+	} else if (VM_TYPE (page->operations->type) == VM_ANON
+			&& anon_is_swapped (page))
+		c->swapped += n;
+}
+
+/* Formats the line for the range from START to END into B, up to the
+ * backing file. */
+static void
+emit_range (struct memmap_buf *b, void *start, void *end, bool writable,
+		const char *type, const struct memmap_counts *c) {
+	emit (b, "%012llx-%012llx %4s %-4s %6zu %6zu %6zu %6zu %6zu",
+			(unsigned long long) start, (unsigned long long) end,
+			writable ? "rw" : "r-", type, (size_t) (end - start) / PGSIZE,
+			c->resident, c->swapped, c->dirty, c->shared);
+}
+
+/* Formats FORMAT into B, after what is there. */
+static void
+emit (struct memmap_buf *b, const char *format, ...) {
+	va_list args;
+	size_t ofs = b->len < b->size ? b->len : b->size;
+
+	va_start (args, format);
+	b->len += vsnprintf (b->buf + ofs, b->size - ofs, format, args);
+	va_end (args);
+}
+
+/* Records T in AUX, a struct memmap_find, if it is the thread looked
+ * for, as an action function for thread_foreach(). */
+static void
+find_thread (struct thread *t, void *aux) {
+	struct memmap_find *find = aux;
+
+	if (t->tid == find->tid)
+		find->thread = t;
+}
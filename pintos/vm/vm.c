@@ -1,9 +1,154 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include "devices/timer.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
+/* Frame table.
+ * Every frame that holds a user page is on frame_list, in the order
+ * the clock hand sweeps them.  frame_lock protects the list, the hand
+ * and the links between pages and their frames.  It is released while
+ * an eviction writes a frame out, and a process that faults on a page
+ * being evicted waits in page_frame_wait() until it is out. */
+static struct list frame_list;
+static struct list_elem *clock_hand;  /* Next frame to consider. */
+static size_t frame_cnt;              /* Number of frames in the list. */
+static struct lock frame_lock;
+
+/* Statistics. */
+static long long fault_cnt;           /* Page faults resolved. */
+static long long evict_cnt;           /* Frames evicted. */
+static long long evict_dirty_cnt;     /* Dirty frames evicted. */
+static long long evict_shared_cnt;    /* Shared frames evicted. */
+static long long share_cnt;           /* Frames shared by fork(). */
+static long long cow_cnt;             /* Shared frames copied on write. */
+static long long zero_map_cnt;        /* Read faults given the zero frame. */
+static long long zero_cow_cnt;        /* ...that were later written. */
+
+/* Pages to map around a fault on file data, and the most that
+ * sequential faults ramp up to. */
+unsigned vm_fault_around = 8;
+#define FAULT_AROUND_MAX 64
+
+static long long file_fault_cnt;      /* Faults that read a file. */
+static long long file_mapped;         /* Bytes mapped from files. */
+static long long around_cnt;          /* Pages mapped around faults. */
+/* Huge pages, off unless the -huge option is given.  A fault in an
+ * aligned 2 MB block of a writable region that would only be
+ * zero-filled, none of whose pages exist yet, maps the whole block
+ * with one huge frame and one struct page.  The frame is split back
+ * into 4 kB frames and pages before anything that works on single
+ * pages touches it: eviction, fork and MADV_DONTNEED of part of it. */
+bool vm_huge_pages = false;
+static long long huge_fault_cnt;      /* Faults that mapped huge pages. */
+static long long huge_fallback_cnt;   /* ...that found no huge frame. */
+static long long huge_split_cnt;      /* Huge pages split. */
+
+static long long willneed_cnt;        /* Pages read for MADV_WILLNEED. */
+static long long dontneed_cnt;        /* Pages dropped for MADV_DONTNEED. */
+
+/* Free user frames, as percentages of the user pool, below which the
+ * pageout thread starts reclaiming frames and up to which it goes on.
+ * A low watermark of 0 disables it. */
+unsigned vm_wmark_low = 2;
+unsigned vm_wmark_high = 4;
+#define PAGEOUT_BATCH 8       /* Frames reclaimed per frame_lock hold. */
+
+static size_t wmark_low, wmark_high;  /* Watermarks in pages. */
+static struct semaphore pageout_sema; /* Upped to wake the thread. */
+static bool pageout_busy;             /* Reclaiming right now? */
+static long long pageout_wake_cnt;    /* Times the thread woke. */
+static long long bg_reclaim_cnt;      /* Frames freed by the thread. */
+static long long direct_reclaim_cnt;  /* Frames evicted by faults. */
+
+/* Resident-set limits.  A process that has RSS_LIMIT pages resident
+ * evicts one of its own frames for each page it brings in, through
+ * the same clock as global reclaim, before it may take a free frame.
+ * Only frames that no other process maps count as its own. */
+size_t vm_rss_limit = 0;
+static long long self_reclaim_cnt;    /* Frames evicted by their owner. */
+
+/* Out-of-memory killing.  When no frame can be had, even by eviction,
+ * because swap is full or every frame is pinned, a process is killed
+ * with exit status -1 to make room.  It cannot be stopped from another
+ * thread, so its frames are taken from it at once, and it exits when
+ * it next runs user code.  A thread that ran out kills at most
+ * OOM_KILL_MAX processes before it gives up on a frame. */
+#define OOM_KILL_MAX 4
+static long long oom_kill_cnt;        /* Processes killed. */
+static long long oom_reap_cnt;        /* Frames taken from them. */
+static bool oom_kill (void);
+static void oom_reap (struct thread *victim);
+static void pageout (void *aux);
+
+/* Same-page merging.  The ksm thread walks the frame table with its
+ * own hand, hashing anonymous frames.  A frame whose hash is the same
+ * as at its last scan is unlikely to change soon, and is looked up in
+ * ksm_table by hash; if an identical frame is found there, both are
+ * write-protected and one takes over the other's mapping, which is
+ * later copied again by vm_handle_wp() if written.  Merged frames
+ * stay in ksm_table so that more copies can join them.  The table is
+ * emptied at the end of each sweep, since the hashes of frames that
+ * are not merged go stale.  All of it is protected by frame_lock. */
+unsigned vm_ksm_pages = 0;
+unsigned vm_ksm_interval = 20;
+static struct hash ksm_table;
+static struct list_elem *ksm_hand;    /* Next frame to scan. */
+static long long ksm_scan_cnt;        /* Frames hashed. */
+static long long ksm_merge_cnt;       /* Frames freed by merging. */
+static long long ksm_unmerge_cnt;     /* Merged frames copied on write. */
+static long long ksm_sweep_cnt;       /* Sweeps of the frame table. */
+static hash_hash_func ksm_hash;
+static hash_less_func ksm_less;
+static void ksm (void *aux);
+
+/* Writing back dirty mapped pages. */
+#define FLUSH_BATCH 16        /* Pages written per frame_lock hold. */
+
+/* The page cache: pages of files in memory, shared by every process
+ * that maps them.  A page is identified by the file data it holds.
+ * Read-only pages of executables are kept in text_cache, where the key
+ * also has how many bytes of the page come from the file, since two
+ * segments may map parts of the same file page.  Pages of shared file
+ * mappings are kept in file_cache, keyed the same way: file_read() and
+ * file_write() go through the pages that hold all of the file data in
+ * their part of the file (see vm_cache_read()), so that the data are
+ * in memory once and every view of the file agrees.  The last page of
+ * a mapping that ends before the file does holds zeros after its end
+ * and is left out of that.
+ * Entries are protected by frame_lock and live as long as their
+ * frame. */
+struct cache_entry {
+	struct hash_elem elem;       /* Element in TABLE. */
+	struct hash *table;          /* text_cache or file_cache. */
+	struct inode *inode;         /* File, with a reference held. */
+	off_t offset;                /* Offset of the page in INODE. */
+	size_t read_bytes;           /* Bytes from INODE; the rest is 0. */
+	struct frame *frame;         /* Frame holding the page. */
+};
+static struct hash text_cache;
+static struct hash file_cache;
+static long long text_hit_cnt;        /* Faults served from text_cache. */
+static long long file_hit_cnt;        /* Faults served from file_cache. */
+static long long cache_read_cnt;      /* Bytes read() from file_cache. */
+static long long cache_write_cnt;     /* Bytes written to file_cache. */
+static hash_hash_func cache_hash;
+static hash_less_func cache_less;
+
+/* A page of zeros, mapped read-only for reads of anonymous memory
+ * that has never been written.  It is not in the frame table. */
+static struct frame zero_frame;
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -15,7 +160,66 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	list_init (&frame_list);
+	lock_init (&frame_lock);
+	zero_frame.kva = palloc_get_page (PAL_USER | PAL_ZERO | PAL_ASSERT);
+	zero_frame.ref_cnt = 1;
+	if (!hash_init (&text_cache, cache_hash, cache_less, NULL)
+			|| !hash_init (&file_cache, cache_hash, cache_less, NULL)
+			|| !hash_init (&ksm_table, ksm_hash, ksm_less, NULL))
+		PANIC ("vm_init: out of memory");
+
+	wmark_low = palloc_user_page_cnt () * vm_wmark_low / 100;
+	wmark_high = palloc_user_page_cnt () * vm_wmark_high / 100;
+	if (wmark_high < wmark_low)
+		wmark_high = wmark_low;
+	sema_init (&pageout_sema, 0);
+	if (wmark_low > 0 && thread_create ("pageout", PRI_DEFAULT, pageout,
+				NULL) == TID_ERROR)
+		PANIC ("vm_init: cannot start pageout thread");
+	if (vm_ksm_pages > 0
+			&& thread_create ("ksm", PRI_DEFAULT, ksm, NULL) == TID_ERROR)
+		PANIC ("vm_init: cannot start ksm thread");
+}
+
+/* Prints VM statistics. */
+void
+vm_print_stats (void) {
+	printf ("VM: %lld page faults, %lld evictions (%lld dirty, "
+			"%lld shared)\n", fault_cnt, evict_cnt, evict_dirty_cnt,
+			evict_shared_cnt);
+	printf ("VM: %lld frames reclaimed by pageout in %lld wakeups, "
+			"%lld by faulting threads\n", bg_reclaim_cnt, pageout_wake_cnt,
+			direct_reclaim_cnt);
+	printf ("VM: %lld frames reclaimed by processes at their RSS limit, "
+			"%lld processes killed for lack of memory (%lld frames taken)\n",
+			self_reclaim_cnt, oom_kill_cnt, oom_reap_cnt);
+	printf ("VM: %lld pages shared by fork, %lld copied on write\n",
+			share_cnt, cow_cnt);
+	printf ("VM: %lld faults read %lld kB mapped from files "
+			"(%lld per MB), %lld pages mapped around them\n",
+			file_fault_cnt, file_mapped / 1024,
+			file_mapped != 0 ? file_fault_cnt * (1 << 20) / file_mapped : 0,
+			around_cnt);
+	printf ("VM: %lld faults mapped 2 MB pages, %lld fell back to 4 kB "
+			"pages, %lld 2 MB pages split\n", huge_fault_cnt, huge_fallback_cnt,
+			huge_split_cnt);
+	printf ("VM: %lld pages read ahead for MADV_WILLNEED, %lld dropped "
+			"for MADV_DONTNEED\n", willneed_cnt, dontneed_cnt);
+	printf ("VM: %zu executable pages cached, %lld faults served from "
+			"them\n", hash_size (&text_cache), text_hit_cnt);
+	printf ("VM: %zu mapped file pages cached, %lld faults served from "
+			"them, %lld kB read and %lld kB written through them\n",
+			hash_size (&file_cache), file_hit_cnt, cache_read_cnt / 1024,
+			cache_write_cnt / 1024);
+	printf ("VM: %lld reads mapped the zero page, %lld later written "
+			"(%lld kB saved)\n", zero_map_cnt, zero_cow_cnt,
+			(zero_map_cnt - zero_cow_cnt) * PGSIZE / 1024);
+	printf ("VM: %lld frames scanned for merging in %lld sweeps, "
+			"%lld merged, %lld copied again on write\n", ksm_scan_cnt,
+			ksm_sweep_cnt, ksm_merge_cnt, ksm_unmerge_cnt);
+	vm_anon_print_stats ();
+	vm_file_print_stats ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -33,9 +237,53 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (struct thread *owner);
 static bool vm_do_claim_page (struct page *page);
-static struct frame *vm_evict_frame (void);
+static struct frame *vm_evict_frame (struct thread *owner);
+static struct page *page_create (void *va, enum vm_type type, bool writable,
+		struct vm_region *region, vm_initializer *init, void *aux);
+static bool region_load (struct page *page, void *aux);
+static void frame_put (struct frame *frame, struct page *page);
+static bool share_page (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src, struct page *page,
+		struct vm_region *region);
+static void frame_release (struct frame *frame);
+static struct frame *frame_get (bool may_evict);
+static bool zero_fill (struct page *page, void *aux);
+static bool is_zero_fill (const struct page *page);
+static bool map_zero_page (struct page *page);
+static bool is_file_fill (const struct page *page);
+static struct hash *page_cache (const struct page *page);
+static void pageout_check (void);
+static bool claim_file_page (struct page *page, bool prefetch);
+static void cache_key (const struct page *page, struct cache_entry *key);
+static struct frame *cache_find (struct hash *table, struct inode *inode,
+		off_t offset, size_t read_bytes);
+static struct frame *file_cache_find (struct inode *inode, off_t offset,
+		off_t length);
+static void cache_forget (struct frame *frame);
+static struct frame *page_frame_wait (struct page *page);
+static bool frame_fill (struct frame *frame, struct page *page);
+static void fault_around (struct page *page);
+static void ksm_forget (struct frame *frame);
+static void frame_init (struct frame *frame, void *kva);
+static bool huge_fault (struct supplemental_page_table *spt, void *addr);
+static bool huge_split (struct page *page);
+static bool huge_try_split (struct frame *frame);
+static bool huge_split_at (struct supplemental_page_table *spt, void *va);
+static struct rmap_entry rmap_get (const struct frame *frame, unsigned i);
+static bool rmap_add (struct frame *frame, struct page *page,
+		struct thread *owner);
+static void rmap_remove (struct frame *frame, struct page *page);
+static bool evict_shared (struct frame *frame);
+static bool file_frame_save (struct frame *frame, struct page *page,
+		uint64_t *pml4);
+static void rmap_fold_dirty (const struct frame *frame);
+static void frame_attach (struct frame *frame, struct page *page);
+static void rss_add (struct thread *owner, const struct page *page);
+static void rss_sub (struct thread *owner, const struct page *page,
+		bool evicted);
+static bool rss_at_limit (const struct thread *t, size_t pages);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -49,142 +297,2584 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 	struct supplemental_page_table *spt = &thread_current ()->spt;
 
 	/* Check wheter the upage is already occupied or not. */
-	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+	if (spt_find_page (spt, upage) == NULL
+			&& spt_find_region (spt, upage) == NULL) {
+		struct page *page = page_create (upage, type, writable, NULL,
+				init != NULL ? init : zero_fill, aux);
+		if (page == NULL)
+			goto err;
 
-		/* TODO: Insert the page into the spt. */
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
-/* Find VA from spt and return page. On error, return NULL. */
-struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+/* Creates an uninit page at VA that turns into a page of TYPE when it
+ * is claimed, and then runs INIT with AUX to fill it.  The page is not
+ * inserted into any SPT.  Returns NULL if memory is not available. */
+static struct page *
+page_create (void *va, enum vm_type type, bool writable,
+		struct vm_region *region, vm_initializer *init, void *aux) {
+	struct page *page = malloc (sizeof *page);
+	bool (*initializer) (struct page *, enum vm_type, void *);
+
+	if (page == NULL)
+		return NULL;
 
+	switch (VM_TYPE (type)) {
+		case VM_ANON:
+			initializer = anon_initializer;
+			break;
+		case VM_FILE:
+			initializer = file_backed_initializer;
+			break;
+		default:
+			NOT_REACHED ();
+	}
+	uninit_new (page, pg_round_down (va), init, type, aux, initializer);
+	page->region = region;
+	page->writable = writable;
 	return page;
 }
 
+/* Orders pages by address. */
+static bool
+page_less (const struct rb_elem *a_, const struct rb_elem *b_,
+		void *aux UNUSED) {
+	const struct page *a = rb_entry (a_, struct page, spt_elem);
+	const struct page *b = rb_entry (b_, struct page, spt_elem);
+
+	return a->va < b->va;
+}
+
+/* Orders regions by start address.  Regions never overlap. */
+static bool
+region_less (const struct rb_elem *a_, const struct rb_elem *b_,
+		void *aux UNUSED) {
+	const struct vm_region *a = rb_entry (a_, struct vm_region, elem);
+	const struct vm_region *b = rb_entry (b_, struct vm_region, elem);
+
+	return a->start < b->start;
+}
+
+/* Find VA from spt and return page. On error, return NULL.
+ * Only pages that already have a struct page are found; see
+ * spt_get_page(). */
+struct page *
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page key = { .va = pg_round_down (va) };
+	struct rb_elem *e = rb_find (&spt->pages, &key.spt_elem);
+
+	if (e == NULL) {
+		/* A huge page is found by its first address only. */
+		key.va = (void *) ROUND_DOWN ((uintptr_t) va, HUGE_PGSIZE);
+		e = rb_find (&spt->pages, &key.spt_elem);
+		if (e != NULL && !rb_entry (e, struct page, spt_elem)->huge)
+			e = NULL;
+	}
+	return e != NULL ? rb_entry (e, struct page, spt_elem) : NULL;
+}
+
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	bool success;
 
-	return succ;
+	lock_acquire (&spt->lock);
+	success = rb_insert (&spt->pages, &page->spt_elem) == NULL;
+	lock_release (&spt->lock);
+	return success;
 }
 
+/* Removes PAGE from SPT and frees it. */
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	lock_acquire (&spt->lock);
+	rb_remove (&spt->pages, &page->spt_elem);
+	lock_release (&spt->lock);
 	vm_dealloc_page (page);
+}
+
+/* Returns the page that contains VA in SPT, creating its struct page
+ * from the region that covers VA if this is the first time it is
+ * needed.  Returns NULL if VA is not part of the address space or if
+ * memory is not available. */
+struct page *
+spt_get_page (struct supplemental_page_table *spt, void *va) {
+	struct page *page = spt_find_page (spt, va);
+	struct vm_region *region;
+
+	if (page != NULL)
+		return page;
+
+	region = spt_find_region (spt, va);
+	if (region == NULL)
+		return NULL;
+
+	page = page_create (va, region->type, region->writable, region,
+			region_load, region);
+	if (page != NULL && !spt_insert_page (spt, page)) {
+		free (page);
+		page = NULL;
+	}
+	return page;
+}
+
+/* Fills KVA with the initial contents of the page at VA in REGION:
+ * the part that comes from the region's file, zeros after it.  Only
+ * the region's READ_BYTES come from the file, so the last page of a
+ * mapping never shows the file data that follows it. */
+bool
+vm_region_fill (struct vm_region *region, void *va, void *kva) {
+	size_t ofs = pg_round_down (va) - region->start;
+	size_t read_bytes = 0;
+
+	if (ofs < region->read_bytes) {
+		read_bytes = region->read_bytes - ofs < PGSIZE
+			? region->read_bytes - ofs : PGSIZE;
+		if (file_read_at (region->file, kva, read_bytes, region->offset + ofs)
+				!= (off_t) read_bytes)
+			return false;
+	}
+	memset (kva + read_bytes, 0, PGSIZE - read_bytes);
+	return true;
+}
+
+/* Fills PAGE, which was materialized from region AUX. */
+static bool
+region_load (struct page *page, void *aux) {
+	return vm_region_fill (aux, page->va, page->frame->kva);
+}
+
+/* Fills PAGE with zeros. */
+static bool
+zero_fill (struct page *page, void *aux UNUSED) {
+	memset (page->frame->kva, 0, PGSIZE);
+	return true;
+}
+
+/* Returns the region of SPT that contains VA, or NULL if there is
+ * none. */
+struct vm_region *
+spt_find_region (struct supplemental_page_table *spt, void *va) {
+	struct vm_region key = { .start = va };
+	struct rb_elem *e = rb_floor (&spt->regions, &key.elem);
+	struct vm_region *region;
+
+	if (e == NULL)
+		return NULL;
+	region = rb_entry (e, struct vm_region, elem);
+	return va < region->end ? region : NULL;
+}
+
+/* Inserts REGION into SPT.  Fails if it would overlap another region
+ * or a page of SPT. */
+bool
+spt_insert_region (struct supplemental_page_table *spt,
+		struct vm_region *region) {
+	struct vm_region region_key = { .start = region->start };
+	struct page page_key = { .va = region->start };
+	struct rb_elem *e;
+
+	ASSERT (pg_ofs (region->start) == 0);
+	ASSERT (pg_ofs (region->end) == 0);
+	ASSERT (region->start < region->end);
+
+	/* The region that starts at or below START must end by START,
+	 * and the next one must start at or after END. */
+	e = rb_floor (&spt->regions, &region_key.elem);
+	if (e != NULL && rb_entry (e, struct vm_region, elem)->end > region->start)
+		return false;
+	e = rb_ceiling (&spt->regions, &region_key.elem);
+	if (e != NULL && rb_entry (e, struct vm_region, elem)->start < region->end)
+		return false;
+
+	/* No page may lie within the region. */
+	e = rb_ceiling (&spt->pages, &page_key.spt_elem);
+	if (e != NULL && rb_entry (e, struct page, spt_elem)->va < region->end)
+		return false;
+
+	lock_acquire (&spt->lock);
+	rb_insert (&spt->regions, &region->elem);
+	lock_release (&spt->lock);
+	return true;
+}
+
+/* Removes REGION from SPT and frees it, along with the pages
+ * materialized from it and the page tables that only they used. */
+void
+spt_remove_region (struct supplemental_page_table *spt,
+		struct vm_region *region) {
+	struct page key = { .va = region->start };
+	struct rb_elem *first = rb_ceiling (&spt->pages, &key.spt_elem);
+	struct thread *curr = thread_current ();
+	struct rb_elem *e;
+
+	/* Unmap the region with one TLB flush before giving its frames
+	 * back. */
+	if (curr->pml4 != NULL) {
+		struct mmu_gather tlb;
+
+		mmu_gather_init (&tlb, curr->pml4);
+		for (e = first; e != NULL; e = rb_next (e)) {
+			struct page *page = rb_entry (e, struct page, spt_elem);
+			if (page->va >= region->end)
+				break;
+			if (page->frame != NULL)
+				mmu_gather_clear_page (&tlb, page->va);
+		}
+		mmu_gather_finish (&tlb);
+	}
+
+	for (e = first; e != NULL; ) {
+		struct page *page = rb_entry (e, struct page, spt_elem);
+		if (page->va >= region->end)
+			break;
+		e = rb_next (e);
+		spt_remove_page (spt, page);
+	}
+	if (curr->pml4 != NULL)
+		pml4_free_tables (curr->pml4, region->start, region->end);
+
+	lock_acquire (&spt->lock);
+	rb_remove (&spt->regions, &region->elem);
+	lock_release (&spt->lock);
+	file_close (region->file);
+	free (region);
+}
+
+/* Maps LENGTH bytes at START, which must be page-aligned, as a region
+ * of TYPE in the current process.  The first READ_BYTES bytes are
+ * read from FILE at OFFSET when they are faulted in and the rest are
+ * zero.  On success the region takes over FILE, which may be NULL
+ * for zero-filled memory.
+ * Returns false if the range is not in user space, overlaps memory
+ * that is already mapped, or memory is not available. */
+bool
+vm_alloc_region (void *start, size_t length, enum vm_type type,
+		bool writable, struct file *file, off_t offset, size_t read_bytes) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *end = start + ROUND_UP (length, PGSIZE);
+	struct vm_region *region;
+
+	ASSERT (VM_TYPE (type) == VM_ANON || VM_TYPE (type) == VM_FILE);
+	ASSERT (read_bytes <= length);
+
+	if (pg_ofs (start) != 0 || length == 0 || end <= start
+			|| !is_user_vaddr (start) || !is_user_vaddr (end - 1))
+		return false;
+
+	region = malloc (sizeof *region);
+	if (region == NULL)
+		return false;
+	region->start = start;
+	region->end = end;
+	region->type = type;
+	region->writable = writable;
+	region->file = file;
+	region->offset = offset;
+	region->read_bytes = read_bytes;
+	region->ra_next = NULL;
+	region->ra_pages = 0;
+	region->advice = MADV_NORMAL;
+
+	if (!spt_insert_region (spt, region)) {
+		free (region);
+		return false;
+	}
+	if (file != NULL)
+		file_mapped += read_bytes;
+	return true;
+}
+
+/* Unmaps PAGE of the current process and drops its reference to its
+ * frame, giving the frame back to the user pool if no other page
+ * shares it.  A PAGE that is not in memory is being destroyed, so it
+ * leaves the swap count of the process. */
+void
+vm_free_frame (struct page *page) {
+	struct thread *curr = thread_current ();
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	frame = page_frame_wait (page);
+	if (frame != NULL) {
+		if (curr->pml4 != NULL)
+			pml4_clear_page (curr->pml4, page->va);
+		page->frame = NULL;
+		frame_put (frame, page);
+	} else if (VM_TYPE (page->operations->type) == VM_ANON
+			&& anon_is_swapped (page))
+		curr->swap_cnt--;
+	lock_release (&frame_lock);
+}
+
+/* Unmaps PAGE of a shared file mapping of the current process and
+ * drops its reference to its frame, like vm_free_frame().  The last
+ * page to map the frame writes it back if it was changed; any other
+ * passes its dirty bit on to a page that still maps the frame, which
+ * stays in the file cache.  Returns true if the frame was written. */
+bool
+vm_file_free_frame (struct page *page) {
+	uint64_t *pml4 = thread_current ()->pml4;
+	struct frame *frame;
+	bool written = false;
+
+	lock_acquire (&frame_lock);
+	frame = page_frame_wait (page);
+	if (frame != NULL) {
+		written = file_frame_save (frame, page, pml4);
+		if (pml4 != NULL)
+			pml4_clear_page (pml4, page->va);
+		page->frame = NULL;
+		frame_put (frame, page);
+	}
+	lock_release (&frame_lock);
+	return written;
+}
+
+/* Saves the changes made to FRAME through PAGE, of a shared file
+ * mapping in PML4, before PAGE stops mapping it.  The last page to map
+ * FRAME writes it back if it was changed; any other passes its dirty
+ * bit on to a page that still maps FRAME.  Returns true if FRAME was
+ * written.  Must be called with frame_lock held. */
+static bool
+file_frame_save (struct frame *frame, struct page *page, uint64_t *pml4) {
+	bool written = false;
+
+	if (frame->ref_cnt == 1) {
+		frame->pinned = true;
+		written = file_backed_write_back (page);
+		frame->pinned = false;
+	} else if (pml4 != NULL && pml4_is_dirty (pml4, page->va)) {
+		struct rmap_entry m = rmap_get (frame, frame->page == page);
+
+		pml4_set_dirty (m.owner->pml4, m.page->va, true);
+	}
+	return written;
+}
+
+/* Drops the reference of PAGE, which no longer maps FRAME, and frees
+ * FRAME if it was the last one.  Must be called with frame_lock
+ * held. */
+static void
+frame_put (struct frame *frame, struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (frame->ref_cnt > 0);
+
+	if (frame == &zero_frame)
+		return;
+	rmap_remove (frame, page);
+	if (frame->ref_cnt == 0)
+		frame_release (frame);
+}
+
+/* Returns mapping I of FRAME, where mapping 0 is its PAGE and OWNER.
+ * Must be called with frame_lock held. */
+static struct rmap_entry
+rmap_get (const struct frame *frame, unsigned i) {
+	ASSERT (i < frame->ref_cnt);
+
+	if (i == 0)
+		return (struct rmap_entry) { frame->page, frame->owner };
+	return frame->rmap[i - 1];
+}
+
+/* Adds PAGE, mapped by OWNER, to the mappings of FRAME, which must
+ * have one already.  Returns false if memory runs out.  Must be
+ * called with frame_lock held. */
+static bool
+rmap_add (struct frame *frame, struct page *page, struct thread *owner) {
+	unsigned n = frame->ref_cnt - 1;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (frame->page != NULL);
+
+	if (n == frame->rmap_cap) {
+		unsigned cap = n != 0 ? 2 * n : 2;
+		struct rmap_entry *rmap = realloc (frame->rmap, cap * sizeof *rmap);
+
+		if (rmap == NULL)
+			return false;
+		frame->rmap = rmap;
+		frame->rmap_cap = cap;
+	}
+	frame->rmap[n].page = page;
+	frame->rmap[n].owner = owner;
+	frame->ref_cnt++;
+	rss_add (owner, page);
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Removes PAGE from the mappings of FRAME.  If PAGE was the first,
+ * the last one takes its place, so that a frame that is mapped at
+ * all always has a PAGE and OWNER to be evicted through.  Must be
+ * called with frame_lock held. */
+static void
+rmap_remove (struct frame *frame, struct page *page) {
+	unsigned last = frame->ref_cnt - 1;
+	struct rmap_entry m = rmap_get (frame, last);
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame->page == page) {
+		rss_sub (frame->owner, page, false);
+		frame->page = last > 0 ? m.page : NULL;
+		frame->owner = last > 0 ? m.owner : NULL;
+	} else {
+		unsigned i = 0;
+
+		while (frame->rmap[i].page != page)
+			ASSERT (++i < last);
+		rss_sub (frame->rmap[i].owner, page, false);
+		frame->rmap[i] = m;
+	}
+	frame->ref_cnt--;
+}
+
+/* Returns true if TEST, which is pml4_is_accessed() or
+ * pml4_is_dirty(), is true of any mapping of FRAME.  Must be called
+ * with frame_lock held. */
+static bool
+rmap_test (const struct frame *frame,
+		bool (*test) (uint64_t *, const void *)) {
+	for (unsigned i = 0; i < frame->ref_cnt; i++) {
+		struct rmap_entry m = rmap_get (frame, i);
+
+		if (test (m.owner->pml4, m.page->va))
+			return true;
+	}
+	return false;
+}
+
+/* Clears the accessed bit of every mapping of FRAME.  Must be called
+ * with frame_lock held. */
+static void
+rmap_clear_accessed (const struct frame *frame) {
+	for (unsigned i = 0; i < frame->ref_cnt; i++) {
+		struct rmap_entry m = rmap_get (frame, i);
+
+		pml4_set_accessed (m.owner->pml4, m.page->va, false);
+	}
+}
+
+/* Marks every mapping of FRAME not present, keeping their accessed
+ * and dirty bits.  Mappings in the page table of batch TLB, of which
+ * a merged frame may have many, are flushed when TLB is finished;
+ * those of other processes, one page each as a rule, right away.
+ * Must be called with frame_lock held. */
+static void
+rmap_unmap (const struct frame *frame, struct mmu_gather *tlb) {
+	for (unsigned i = 0; i < frame->ref_cnt; i++) {
+		struct rmap_entry m = rmap_get (frame, i);
+
+		if (m.owner->pml4 == tlb->pml4)
+			mmu_gather_clear_page (tlb, m.page->va);
+		else
+			pml4_clear_page (m.owner->pml4, m.page->va);
+	}
+}
+
+/* Maps FRAME again everywhere rmap_unmap() unmapped it, along with
+ * the dirty bits.  Only a page that is the sole user of a frame it
+ * does not share by merging, or a page of a shared file mapping, may
+ * write to it.  Must be called with frame_lock held. */
+static void
+rmap_remap (const struct frame *frame) {
+	bool exclusive = (frame->ref_cnt == 1 && !frame->merged)
+		|| VM_TYPE (frame->page->operations->type) == VM_FILE;
+
+	for (unsigned i = 0; i < frame->ref_cnt; i++) {
+		struct rmap_entry m = rmap_get (frame, i);
+		bool dirty = pml4_is_dirty (m.owner->pml4, m.page->va);
+
+		/* The page table page already exists, so this cannot fail. */
+		pml4_set_page (m.owner->pml4, m.page->va, frame->kva,
+				exclusive && m.page->writable);
+		if (dirty)
+			pml4_set_dirty (m.owner->pml4, m.page->va, true);
+	}
+}
+
+/* Moves the dirty bits of every mapping of FRAME to its first, so
+ * that writing back through FRAME->page saves changes made through
+ * any of them.  Must be called with frame_lock held. */
+static void
+rmap_fold_dirty (const struct frame *frame) {
+	if (frame->ref_cnt < 2 || !rmap_test (frame, pml4_is_dirty))
+		return;
+	for (unsigned i = 1; i < frame->ref_cnt; i++) {
+		struct rmap_entry m = rmap_get (frame, i);
+
+		pml4_set_dirty (m.owner->pml4, m.page->va, false);
+	}
+	pml4_set_dirty (frame->owner->pml4, frame->page->va, true);
+}
+
+/* Forgets every mapping of FRAME, which has been evicted, leaving it
+ * unused.  Must be called with frame_lock held. */
+static void
+rmap_clear (struct frame *frame) {
+	for (unsigned i = 0; i < frame->ref_cnt; i++) {
+		struct rmap_entry m = rmap_get (frame, i);
+
+		rss_sub (m.owner, m.page, true);
+		m.page->frame = NULL;
+	}
+	free (frame->rmap);
+	frame->rmap = NULL;
+	frame->rmap_cap = 0;
+	frame->page = NULL;
+	frame->owner = NULL;
+	frame->ref_cnt = 1;
+}
+
+/* Removes FRAME from the frame table and frees it.  Must be called
+ * with frame_lock held. */
+static void
+frame_release (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	cache_forget (frame);
+	ksm_forget (frame);
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	if (ksm_hand == &frame->elem)
+		ksm_hand = list_next (ksm_hand);
+	list_remove (&frame->elem);
+	frame_cnt--;
+
+	palloc_free_multiple (frame->kva, frame->huge ? HUGE_PAGE_CNT : 1);
+	free (frame->rmap);
+	free (frame);
+}
+
+/* Lets the swap_out() method of PAGE, which is being evicted, write
+ * out neighbors of PAGE along with it.  Stores PAGE in PAGES[0] and
+ * then each following page of its address space, up to CNT pages in
+ * all, as long as the pages are contiguous, in memory, not pinned,
+ * not recently accessed, and ACCEPT returns true for them.  Pins the
+ * frames of the pages it adds, marks them as being evicted and unmaps
+ * them as part of batch TLB,
+ * which must be for the page table of the owner of PAGE.  Returns the
+ * number of pages stored.  Adds nothing if the owner is changing its
+ * SPT right now.
+ *
+ * The caller must finish TLB, save each added page and then pass it
+ * to vm_evict_cluster_done(). */
+size_t
+vm_evict_cluster (struct page *page, struct page **pages, size_t cnt,
+		bool (*accept) (const struct page *first, const struct page *),
+		struct mmu_gather *tlb) {
+	struct thread *owner = page->frame->owner;
+	struct rb_elem *e = &page->spt_elem;
+	size_t n = 0;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (tlb->pml4 == owner->pml4);
+
+	pages[n++] = page;
+	if (!lock_try_acquire (&owner->spt.lock))
+		return n;
+	while (n < cnt && (e = rb_next (e)) != NULL) {
+		struct page *next = rb_entry (e, struct page, spt_elem);
+
+		if (next->va != page->va + n * PGSIZE
+				|| next->frame == NULL || next->frame->pinned
+				|| next->frame->ref_cnt > 1 || next->frame->page != next
+				|| next->frame->huge
+				|| pml4_is_accessed (owner->pml4, next->va)
+				|| !accept (page, next))
+			break;
+		next->frame->pinned = true;
+		next->frame->evicting = true;
+		mmu_gather_clear_page (tlb, next->va);
+		pages[n++] = next;
+	}
+	lock_release (&owner->spt.lock);
+	return n;
+}
+
+/* Finishes evicting PAGE, which was added to a cluster by
+ * vm_evict_cluster() and has been unmapped and saved, by freeing its
+ * frame. */
+void
+vm_evict_cluster_done (struct page *page) {
+	rss_sub (page->frame->owner, page, true);
+	frame_release (page->frame);
+	page->frame = NULL;
+	evict_cnt++;
+}
+
+/* Releases frame_lock while the swap_out() method of a page that
+ * vm_evict_frame() is evicting writes it out.  The frames being
+ * evicted stay pinned, so that they are not chosen again, and marked
+ * as being evicted, so that any thread that wants to use one waits in
+ * page_frame_wait() until the eviction is over. */
+void
+vm_evict_io_begin (void) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	lock_release (&frame_lock);
+}
+
+/* Takes frame_lock back after vm_evict_io_begin(). */
+void
+vm_evict_io_end (void) {
+	lock_acquire (&frame_lock);
+}
+
+/* Returns the frame under the clock hand and advances the hand. */
+static struct frame *
+clock_next (void) {
+	struct frame *frame;
+
+	if (clock_hand == NULL || clock_hand == list_end (&frame_list))
+		clock_hand = list_begin (&frame_list);
+	frame = list_entry (clock_hand, struct frame, elem);
+	clock_hand = list_next (clock_hand);
+	return frame;
+}
+
+/* Get the struct frame, that will be evicted.
+ * Only frames that no process but OWNER maps are considered, unless
+ * OWNER is null.  Sweeps the clock at most twice.  A frame accessed
+ * since the hand last passed gets a second chance: its accessed bit
+ * is cleared and it is skipped.  The first frame that is neither
+ * accessed nor dirty wins, since dropping it costs no I/O.  If every
+ * such frame is dirty, the first dirty one seen is taken instead.
+ * Returns NULL if every frame is pinned.  Must be called with
+ * frame_lock held. */
 static struct frame *
-vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+vm_get_victim (struct thread *owner) {
+	struct frame *dirty = NULL;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
 
-	return victim;
+	for (size_t i = 0; i < 2 * frame_cnt; i++) {
+		struct frame *frame = clock_next ();
+		struct page *page = frame->page;
+
+		if (frame->pinned || page == NULL || (owner != NULL
+					&& (frame->owner != owner || frame->ref_cnt > 1)))
+			continue;
+		/* A shared frame counts as accessed or dirty if it is through
+		 * any of its mappings.  A page of a region read sequentially
+		 * is not used again soon, however recently it was used. */
+		if (rmap_test (frame, pml4_is_accessed) && (page->region == NULL
+					|| page->region->advice != MADV_SEQUENTIAL))
+			rmap_clear_accessed (frame);
+		else if (frame->huge && !huge_try_split (frame))
+			continue;
+		else if (!rmap_test (frame, pml4_is_dirty))
+			return frame;
+		else if (dirty == NULL)
+			dirty = frame;
+	}
+	return dirty;
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Return NULL on error.
+ * The frame is unmapped from every page that maps it before
+ * swap_out() writes it out, so that no owner can change it halfway;
+ * if that fails, the mappings are put back and another victim is
+ * tried.  Only frames of OWNER are evicted, unless it is null.  Must
+ * be called with frame_lock held, which swap_out() releases while it
+ * does I/O. */
 static struct frame *
-vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+vm_evict_frame (struct thread *owner) {
+	for (size_t tries = 0; tries < frame_cnt; tries++) {
+		struct frame *victim = vm_get_victim (owner);
+		struct mmu_gather tlb;
+		bool dirty, shared;
+
+		if (victim == NULL)
+			break;
+		dirty = rmap_test (victim, pml4_is_dirty);
+		shared = victim->ref_cnt > 1;
+
+		/* Flushed before swap_out() reads the frame, so that no
+		 * stale TLB entry lets an owner change it meanwhile. */
+		victim->pinned = true;
+		victim->evicting = true;
+		mmu_gather_init (&tlb, victim->owner->pml4);
+		rmap_unmap (victim, &tlb);
+		mmu_gather_finish (&tlb);
+		if (shared ? evict_shared (victim) : swap_out (victim->page)) {
+			cache_forget (victim);
+			victim->merged = false;
+			victim->evicting = false;
+			rmap_clear (victim);
+			evict_cnt++;
+			if (dirty)
+				evict_dirty_cnt++;
+			if (shared)
+				evict_shared_cnt++;
+			return victim;
+		}
 
+		/* Keep it resident. */
+		rmap_remap (victim);
+		victim->evicting = false;
+		victim->pinned = false;
+	}
 	return NULL;
 }
 
+/* Saves FRAME, which is shared by anonymous pages and unmapped from
+ * all of them, so that each can be brought back on its own.  The
+ * swap_out() method of its first page writes the frame once, if any
+ * of the pages has no other copy to come back from, and the other
+ * pages then share that copy.  A frame of the file cache is written
+ * back through its first page if it was changed through any.  Returns
+ * true if successful.  Must be called with frame_lock held. */
+static bool
+evict_shared (struct frame *frame) {
+	struct page *page = frame->page;
+	bool write = false;
+
+	if (VM_TYPE (page->operations->type) == VM_FILE) {
+		rmap_fold_dirty (frame);
+		return swap_out (page);
+	}
+	for (unsigned i = 0; i < frame->ref_cnt && !write; i++) {
+		struct rmap_entry m = rmap_get (frame, i);
+
+		ASSERT (VM_TYPE (m.page->operations->type) == VM_ANON);
+		write = anon_needs_write (m.page, m.owner->pml4);
+	}
+	if (write)
+		pml4_set_dirty (frame->owner->pml4, page->va, true);
+	if (!swap_out (page))
+		return false;
+	if (write)
+		for (unsigned i = 1; i < frame->ref_cnt; i++)
+			anon_share_copy (rmap_get (frame, i).page, page);
+	return true;
+}
+
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * and return it.  If no page can be evicted either, a process is killed
+ * to make room and this tries again, up to OOM_KILL_MAX times.  Returns
+ * NULL if that does not help or if the current process is the one
+ * being killed. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	struct frame *frame;
+	int kills = 0;
+
+	while ((frame = frame_get (true)) == NULL) {
+		if (thread_current ()->oom_killed || kills++ == OOM_KILL_MAX)
+			return NULL;
+		if (!oom_kill ())
+			PANIC ("vm_get_frame: out of user memory");
+	}
 
-	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
-/* Growing the stack. */
-static void
-vm_stack_growth (void *addr UNUSED) {
+/* Returns how much killing T would help when memory runs out, in
+ * pages, or -1 if T must not be killed.  Must be called with
+ * frame_lock held. */
+static long long
+oom_badness (const struct thread *t) {
+	if (t->oom_adj <= OOM_ADJ_MIN || t->oom_killed || t->pml4 == NULL)
+		return -1;
+	return (long long) t->rss + t->swap_cnt
+		+ (long long) t->oom_adj * palloc_user_page_cnt () / 1000;
 }
 
-/* Handle the fault on write_protected page */
+/* Kills the process with the highest oom_badness() among those with
+ * pages in memory, takes its frames with oom_reap(), and then lets it
+ * run so that it can exit.  Returns false if there is no process to
+ * kill. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
-}
+oom_kill (void) {
+	struct thread *victim = NULL;
+	long long worst = -1;
+	struct list_elem *e;
 
-/* Return true on success */
-bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+	lock_acquire (&frame_lock);
+	for (e = list_begin (&frame_list); e != list_end (&frame_list);
+			e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, elem);
 
-	return vm_do_claim_page (page);
+		for (unsigned i = 0; frame->page != NULL && i < frame->ref_cnt; i++) {
+			struct thread *owner = rmap_get (frame, i).owner;
+			long long badness = oom_badness (owner);
+
+			if (badness > worst) {
+				victim = owner;
+				worst = badness;
+			}
+		}
+	}
+	if (victim == NULL) {
+		lock_release (&frame_lock);
+		return false;
+	}
+	victim->oom_killed = true;
+	oom_reap (victim);
+	oom_kill_cnt++;
+	lock_release (&frame_lock);
+	thread_yield ();
+	return true;
 }
 
-/* Free the page.
- * DO NOT MODIFY THIS FUNCTION. */
-void
-vm_dealloc_page (struct page *page) {
-	destroy (page);
-	free (page);
+/* Takes every frame of VICTIM, which has been killed, that is not
+ * pinned.  Each is unmapped from VICTIM and loses its reference, so
+ * that a frame that no other process maps goes back to the user pool
+ * now, even if VICTIM is blocked and does not run for a long time.
+ * Changes to a file mapping are written back first; changes to an
+ * anonymous page are lost, as VICTIM exits before it could read them
+ * from user code.  Must be called with frame_lock held. */
+static void
+oom_reap (struct thread *victim) {
+	struct mmu_gather tlb;
+	struct list_elem *e, *next;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	/* Unmap them all with one TLB flush before any is freed. */
+	mmu_gather_init (&tlb, victim->pml4);
+	for (e = list_begin (&frame_list); e != list_end (&frame_list);
+			e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, elem);
+
+		for (unsigned i = 0; !frame->pinned && frame->page != NULL
+				&& i < frame->ref_cnt; i++) {
+			struct rmap_entry m = rmap_get (frame, i);
+
+			if (m.owner == victim)
+				mmu_gather_clear_page (&tlb, m.page->va);
+		}
+	}
+	mmu_gather_finish (&tlb);
+
+	for (e = list_begin (&frame_list); e != list_end (&frame_list); e = next) {
+		struct frame *frame = list_entry (e, struct frame, elem);
+
+		next = list_next (e);
+		if (frame->pinned || frame->page == NULL)
+			continue;
+
+		/* Going down, since rmap_remove() moves the last mapping into
+		 * the place of the one removed.  Only the last reference,
+		 * at I == 0, frees FRAME. */
+		for (unsigned i = frame->ref_cnt; i-- > 0; ) {
+			struct rmap_entry m = rmap_get (frame, i);
+
+			if (m.owner != victim)
+				continue;
+			if (VM_TYPE (m.page->operations->type) == VM_FILE)
+				file_frame_save (frame, m.page, victim->pml4);
+			else if (anon_is_swapped (m.page))
+				victim->swap_cnt++;
+			m.page->frame = NULL;
+			frame_put (frame, m.page);
+			oom_reap_cnt++;
+		}
+	}
 }
 
-/* Claim the page that allocate on VA. */
-bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+/* Returns a pinned frame from the user pool, or if it is empty and
+ * MAY_EVICT is true, from evicting a page.  Returns NULL if neither
+ * works.  A process at its resident-set limit gets one of its own
+ * frames instead, evicted for the purpose, or nothing if MAY_EVICT is
+ * false. */
+static struct frame *
+frame_get (bool may_evict) {
+	struct thread *curr = thread_current ();
+	struct frame *frame = NULL;
+	void *kva = NULL;
 
-	return vm_do_claim_page (page);
+	lock_acquire (&frame_lock);
+	if (rss_at_limit (curr, 1)) {
+		if (!may_evict) {
+			lock_release (&frame_lock);
+			return NULL;
+		}
+		frame = vm_evict_frame (curr);
+		if (frame != NULL) {
+			curr->reclaim_cnt++;
+			self_reclaim_cnt++;
+		}
+	}
+	if (frame == NULL)
+		kva = palloc_get_page (PAL_USER);
+	if (kva != NULL) {
+		frame = malloc (sizeof *frame);
+		if (frame == NULL)
+			palloc_free_page (kva);
+		else {
+			frame_init (frame, kva);
+			/* Just behind the hand, so it is considered last. */
+			list_insert (clock_hand != NULL ? clock_hand : list_end (&frame_list),
+					&frame->elem);
+			frame_cnt++;
+		}
+	}
+	if (frame == NULL && may_evict) {
+		frame = vm_evict_frame (NULL);
+		if (frame != NULL)
+			direct_reclaim_cnt++;
+	}
+	if (wmark_low > 0)
+		pageout_check ();
+
+	/* Pinned until it has been filled and mapped. */
+	if (frame != NULL)
+		frame->pinned = true;
+	lock_release (&frame_lock);
+	return frame;
 }
 
-/* Claim the PAGE and set up the mmu. */
-static bool
-vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+/* Makes unused FRAME hold PAGE of the current process.  Must be
+ * called with frame_lock held. */
+static void
+frame_attach (struct frame *frame, struct page *page) {
+	struct thread *curr = thread_current ();
 
-	/* Set links */
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (frame->page == NULL);
+
+	/* Unless it is replacing a frame, PAGE comes back from swap. */
+	if (page->frame == NULL && VM_TYPE (page->operations->type) == VM_ANON
+			&& anon_is_swapped (page))
+		curr->swap_cnt--;
 	frame->page = page;
+	frame->owner = curr;
 	page->frame = frame;
+	rss_add (curr, page);
+}
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+/* Adds PAGE, which OWNER has just mapped, to the resident set of
+ * OWNER.  Must be called with frame_lock held. */
+static void
+rss_add (struct thread *owner, const struct page *page) {
+	owner->rss += page->huge ? HUGE_PAGE_CNT : 1;
+	if (owner->rss > owner->rss_peak)
+		owner->rss_peak = owner->rss;
+}
 
-	return swap_in (page, frame->kva);
+/* Takes PAGE, which OWNER no longer maps, out of the resident set of
+ * OWNER.  If it was EVICTED with a copy saved in swap, it now counts
+ * as swapped.  Must be called with frame_lock held. */
+static void
+rss_sub (struct thread *owner, const struct page *page, bool evicted) {
+	owner->rss -= page->huge ? HUGE_PAGE_CNT : 1;
+	if (evicted && VM_TYPE (page->operations->type) == VM_ANON
+			&& anon_is_swapped (page))
+		owner->swap_cnt++;
 }
 
-/* Initialize new supplemental page table */
-void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+/* Returns true if T has a resident-set limit and bringing in PAGES
+ * more pages would exceed it.  Must be called with frame_lock
+ * held. */
+static bool
+rss_at_limit (const struct thread *t, size_t pages) {
+	return t->rss_limit != 0 && t->rss + pages > t->rss_limit;
 }
 
-/* Copy supplemental page table from src to dst */
-bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+/* Sets the out-of-memory adjustment of the current process to ADJ,
+ * clamped to OOM_ADJ_MIN...OOM_ADJ_MAX, and returns the old one. */
+int
+vm_set_oom_adj (int adj) {
+	struct thread *curr = thread_current ();
+	int old;
+
+	lock_acquire (&frame_lock);
+	old = curr->oom_adj;
+	curr->oom_adj = adj < OOM_ADJ_MIN ? OOM_ADJ_MIN
+		: adj > OOM_ADJ_MAX ? OOM_ADJ_MAX : adj;
+	lock_release (&frame_lock);
+	return old;
 }
 
-/* Free the resource hold by the supplemental page table */
+/* Sets the resident-set limit of the current process to PAGES pages,
+ * or removes it if PAGES is 0, and returns the old limit.  Frames of
+ * the process are evicted right away until it is under the new
+ * limit, as far as they can be. */
+size_t
+vm_set_rss_limit (size_t pages) {
+	struct thread *curr = thread_current ();
+	size_t old;
+
+	lock_acquire (&frame_lock);
+	old = curr->rss_limit;
+	curr->rss_limit = pages;
+	while (rss_at_limit (curr, 0)) {
+		struct frame *frame = vm_evict_frame (curr);
+
+		if (frame == NULL)
+			break;
+		frame_release (frame);
+		curr->reclaim_cnt++;
+		self_reclaim_cnt++;
+	}
+	lock_release (&frame_lock);
+	return old;
+}
+
+/* Stores the memory use of the current process in USAGE, which may
+ * be in user memory. */
+void
+vm_get_mem_usage (struct mem_usage *usage) {
+	struct thread *curr = thread_current ();
+	struct mem_usage u;
+
+	/* Copied out afterward, since that may fault. */
+	lock_acquire (&frame_lock);
+	u.rss = curr->rss;
+	u.rss_peak = curr->rss_peak;
+	u.rss_limit = curr->rss_limit;
+	u.swap = curr->swap_cnt;
+	u.reclaim = curr->reclaim_cnt;
+	lock_release (&frame_lock);
+	/* Only this process changes its page tables. */
+	u.pt_pages = pml4_table_cnt (curr->pml4);
+	*usage = u;
+}
+
+/* Returns true if FRAME is the zero frame, which pages that have only
+ * been read share. */
+bool
+vm_is_zero_frame (const struct frame *frame) {
+	return frame == &zero_frame;
+}
+
+/* Takes frame_lock if no thread holds it, so that frames and their
+ * mappings can be read as they are, and returns true if it did.  Does
+ * not sleep, so it may be called with interrupts off. */
+bool
+vm_frame_table_try_lock (void) {
+	return lock_try_acquire (&frame_lock);
+}
+
+/* Releases frame_lock, taken by vm_frame_table_try_lock(). */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+vm_frame_table_unlock (void) {
+	lock_release (&frame_lock);
+}
+
+/* Initializes FRAME, whose memory is at KVA, as unused. */
+static void
+frame_init (struct frame *frame, void *kva) {
+	frame->kva = kva;
+	frame->page = NULL;
+	frame->owner = NULL;
+	frame->ref_cnt = 1;
+	frame->rmap = NULL;
+	frame->rmap_cap = 0;
+	frame->cache = NULL;
+	frame->evicting = false;
+	frame->huge = false;
+	frame->merged = false;
+	frame->sum = 0;
+	frame->listed = false;
+}
+
+/* The pageout thread.  Whenever free user frames run short of the low
+ * watermark, it evicts frames in batches until the high watermark is
+ * reached, so that faults seldom have to evict frames themselves. */
+static void
+pageout (void *aux UNUSED) {
+	for (;;) {
+		bool progress = true;
+
+		sema_down (&pageout_sema);
+		pageout_wake_cnt++;
+		while (progress && palloc_user_free_cnt () < wmark_high) {
+			lock_acquire (&frame_lock);
+			for (int i = 0; i < PAGEOUT_BATCH; i++) {
+				struct frame *frame = vm_evict_frame (NULL);
+
+				if (frame == NULL) {
+					progress = false;
+					break;
+				}
+				frame_release (frame);
+				bg_reclaim_cnt++;
+			}
+			lock_release (&frame_lock);
+			thread_yield ();
+		}
+		pageout_busy = false;
+	}
+}
+
+/* Wakes the pageout thread if free user frames are below the low
+ * watermark.  Must be called with frame_lock held. */
+static void
+pageout_check (void) {
+	if (!pageout_busy && palloc_user_free_cnt () < wmark_low) {
+		pageout_busy = true;
+		sema_up (&pageout_sema);
+	}
+}
+
+/* Brings PAGE of the current process into memory ahead of a fault,
+ * if there is a free frame for it.  The page is mapped but not
+ * marked accessed, so it is the first to go again if it is not
+ * used. */
+bool
+vm_prefetch_page (struct page *page) {
+	struct frame *frame = frame_get (false);
+
+	if (frame == NULL)
+		return false;
+	lock_acquire (&frame_lock);
+	frame_attach (frame, page);
+	lock_release (&frame_lock);
+	return frame_fill (frame, page);
+}
+
+/* Fills FRAME, which frame_get() returned pinned and which has just
+ * been attached to PAGE, and maps it at PAGE in the current process.
+ * The frame is unpinned once the process can see it.  Returns true
+ * if successful; otherwise PAGE is left without a frame. */
+static bool
+frame_fill (struct frame *frame, struct page *page) {
+	if (!swap_in (page, frame->kva)
+			|| !pml4_set_page (thread_current ()->pml4, page->va, frame->kva,
+				page->writable)) {
+		vm_free_frame (page);
+		return false;
+	}
+	frame->pinned = false;
+	return true;
+}
+
+/* Returns true if FRAME holds a file-backed page that its owner has
+ * changed since it was last written back.  Must be called with
+ * frame_lock held. */
+static bool
+is_dirty_file_frame (const struct frame *frame) {
+	struct page *page = frame->page;
+
+	return !frame->pinned && page != NULL && page->frame == frame
+		&& VM_TYPE (page->operations->type) == VM_FILE
+		&& frame->owner->pml4 != NULL
+		&& pml4_is_dirty (frame->owner->pml4, page->va);
+}
+
+/* Writes dirty file-backed pages of every process back to their
+ * files, FLUSH_BATCH per frame_lock hold so that faults are not held
+ * up for long.  Pages dirtied again meanwhile are left for the next
+ * call.  Returns the number of pages written. */
+size_t
+vm_writeback_all (void) {
+	size_t budget, written = 0;
+	bool found = true;
+
+	lock_acquire (&frame_lock);
+	budget = frame_cnt;
+	lock_release (&frame_lock);
+
+	while (found && written < budget) {
+		struct list_elem *e;
+		int batch = 0;
+
+		found = false;
+		lock_acquire (&frame_lock);
+		for (e = list_begin (&frame_list); e != list_end (&frame_list)
+				&& batch < FLUSH_BATCH && written < budget;
+				e = list_next (e)) {
+			struct frame *frame = list_entry (e, struct frame, elem);
+
+			if (frame->cache != NULL)
+				rmap_fold_dirty (frame);
+			if (is_dirty_file_frame (frame)) {
+				frame->pinned = true;
+				if (file_backed_write_back (frame->page)) {
+					written++;
+					batch++;
+					found = true;
+				}
+				frame->pinned = false;
+			}
+		}
+		lock_release (&frame_lock);
+		thread_yield ();
+	}
+	return written;
+}
+
+/* Writes the dirty file-backed pages of the current process between
+ * START and END back to their files.  Returns the number of pages
+ * written. */
+size_t
+vm_writeback_range (void *start, void *end) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page key = { .va = pg_round_down (start) };
+	struct rb_elem *e;
+	size_t written = 0;
+
+	/* Only this thread changes its SPT, so it may walk it unlocked. */
+	for (e = rb_ceiling (&spt->pages, &key.spt_elem); e != NULL;
+			e = rb_next (e)) {
+		struct page *page = rb_entry (e, struct page, spt_elem);
+		struct frame *frame;
+
+		if (page->va >= end)
+			break;
+		lock_acquire (&frame_lock);
+		frame = page_frame_wait (page);
+		if (frame != NULL && frame->cache != NULL)
+			rmap_fold_dirty (frame);
+		/* A frame of the file cache is written through its first page,
+		 * which may be another process's. */
+		if (frame != NULL && is_dirty_file_frame (frame)) {
+			frame->pinned = true;
+			if (file_backed_write_back (frame->page))
+				written++;
+			frame->pinned = false;
+		}
+		lock_release (&frame_lock);
+	}
+	return written;
+}
+
+/* Reads the pages of the current process between START and END that
+ * are not in memory and would have to be read from a file or swap,
+ * while there are free frames for them.  Zero-filled pages are left
+ * to be allocated when they are touched. */
+static void
+madvise_willneed (void *start, void *end) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	for (void *va = start; va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (page == NULL) {
+			struct vm_region *region = spt_find_region (spt, va);
+
+			if (region == NULL || region->file == NULL
+					|| (size_t) (va - region->start) >= region->read_bytes)
+				continue;
+			page = spt_get_page (spt, va);
+			if (page == NULL)
+				break;
+		}
+		if (page->frame != NULL
+				|| !(is_file_fill (page) || (VM_TYPE (page->operations->type)
+						== VM_ANON && anon_is_swapped (page))))
+			continue;
+		if (!(is_file_fill (page) ? claim_file_page (page, true)
+					: vm_prefetch_page (page)))
+			break;
+		willneed_cnt++;
+	}
+}
+
+/* Drops the pages of the current process between START and END,
+ * and the page tables that only they used.  Changes to mapped files
+ * are written back first.  The next touch reads a page of a file
+ * region from the file again and finds any other page zeroed.
+ * Returns false if a huge page that sticks out of the range could not
+ * be split or if memory runs out, in which case no page in the range
+ * has been dropped. */
+static bool
+madvise_dontneed (void *start, void *end) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page key = { .va = start };
+	struct page **fresh = NULL;
+	size_t fresh_cnt = 0;
+	size_t i;
+	struct rb_elem *e;
+
+	if (!huge_split_at (spt, start) || !huge_split_at (spt, end))
+		return false;
+
+	/* Without a region to come back from, a page needs a fresh
+	 * zero-filled one.  Make them all before dropping anything, so
+	 * that running out of memory leaves the range as it was. */
+	for (e = rb_ceiling (&spt->pages, &key.spt_elem); e != NULL;
+			e = rb_next (e)) {
+		struct page *page = rb_entry (e, struct page, spt_elem);
+		if (page->va >= end)
+			break;
+		if (page->region == NULL)
+			fresh_cnt++;
+	}
+	if (fresh_cnt > 0) {
+		fresh = calloc (fresh_cnt, sizeof *fresh);
+		if (fresh == NULL)
+			return false;
+		i = 0;
+		for (e = rb_ceiling (&spt->pages, &key.spt_elem); i < fresh_cnt;
+				e = rb_next (e)) {
+			struct page *page = rb_entry (e, struct page, spt_elem);
+			if (page->region != NULL)
+				continue;
+			fresh[i] = page_create (page->va, VM_ANON, page->writable, NULL,
+					zero_fill, NULL);
+			if (fresh[i++] == NULL) {
+				while (i-- > 0)
+					free (fresh[i]);
+				free (fresh);
+				return false;
+			}
+		}
+	}
+
+	/* Unmap the range with one TLB flush before giving its frames
+	 * back. */
+	if (thread_current ()->pml4 != NULL) {
+		struct mmu_gather tlb;
+
+		mmu_gather_init (&tlb, thread_current ()->pml4);
+		for (e = rb_ceiling (&spt->pages, &key.spt_elem); e != NULL;
+				e = rb_next (e)) {
+			struct page *page = rb_entry (e, struct page, spt_elem);
+			if (page->va >= end)
+				break;
+			if (page->frame != NULL)
+				mmu_gather_clear_page (&tlb, page->va);
+		}
+		mmu_gather_finish (&tlb);
+	}
+
+	i = 0;
+	e = rb_ceiling (&spt->pages, &key.spt_elem);
+	while (e != NULL) {
+		struct page *page = rb_entry (e, struct page, spt_elem);
+		bool in_region = page->region != NULL;
+
+		if (page->va >= end)
+			break;
+		e = rb_next (e);
+		dontneed_cnt += page->huge ? HUGE_PAGE_CNT : 1;
+		spt_remove_page (spt, page);
+		/* The fresh page takes the place just given up. */
+		if (!in_region && !spt_insert_page (spt, fresh[i++]))
+			NOT_REACHED ();
+	}
+	free (fresh);
+	if (thread_current ()->pml4 != NULL)
+		pml4_free_tables (thread_current ()->pml4, start, end);
+	return true;
+}
+
+/* Takes the ADVICE of the current process on the pages in the LENGTH
+ * bytes at ADDR, which must be page-aligned.  MADV_NORMAL, MADV_RANDOM
+ * and MADV_SEQUENTIAL are kept in each region that overlaps the range,
+ * as a whole, for fault_around(), swap readahead and the clock to
+ * consult.  MADV_WILLNEED and MADV_DONTNEED act on the range right
+ * away.  Returns 0 on success or -1 if the arguments are bad or
+ * memory runs out. */
+int
+do_madvise (void *addr, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *end = addr + ROUND_UP (length, PGSIZE);
+	struct vm_region key = { .start = addr };
+	struct vm_region *region;
+	struct rb_elem *e;
+
+	if (pg_ofs (addr) != 0 || end < addr || !is_user_vaddr (addr)
+			|| (end > addr && !is_user_vaddr (end - 1)))
+		return -1;
+
+	switch (advice) {
+		case MADV_NORMAL:
+		case MADV_RANDOM:
+		case MADV_SEQUENTIAL:
+			region = spt_find_region (spt, addr);
+			e = region != NULL ? &region->elem
+				: rb_ceiling (&spt->regions, &key.elem);
+			for (; e != NULL; e = rb_next (e)) {
+				region = rb_entry (e, struct vm_region, elem);
+				if (region->start >= end)
+					break;
+				region->advice = advice;
+				region->ra_next = NULL;
+				region->ra_pages = 0;
+			}
+			return 0;
+		case MADV_WILLNEED:
+			madvise_willneed (addr, end);
+			return 0;
+		case MADV_DONTNEED:
+			return madvise_dontneed (addr, end) ? 0 : -1;
+		default:
+			return -1;
+	}
+}
+
+/* Growing the stack. */
+static void
+vm_stack_growth (void *addr UNUSED) {
+}
+
+/* Returns true if PAGE is anonymous memory that has never been in a
+ * frame and would start out all zeros. */
+static bool
+is_zero_fill (const struct page *page) {
+	struct vm_region *region = page->region;
+
+	if (VM_TYPE (page->operations->type) != VM_UNINIT
+			|| VM_TYPE (page->uninit.type) != VM_ANON)
+		return false;
+	if (page->uninit.init == zero_fill)
+		return true;
+	return page->uninit.init == region_load
+		&& (size_t) (page->va - region->start) >= region->read_bytes;
+}
+
+/* Maps the zero frame read-only at PAGE, which is_zero_fill()
+ * accepts, so that reading it costs no frame.  Writing it faults
+ * into vm_handle_wp(), which gives it a frame of its own. */
+static bool
+map_zero_page (struct page *page) {
+	if (!anon_initializer (page, page->uninit.type, NULL))
+		return false;
+	lock_acquire (&frame_lock);
+	page->frame = &zero_frame;
+	zero_map_cnt++;
+	lock_release (&frame_lock);
+	if (!pml4_set_page (thread_current ()->pml4, page->va, zero_frame.kva,
+				false)) {
+		vm_free_frame (page);
+		return false;
+	}
+	return true;
+}
+
+/* Handle the fault on write_protected page */
+static bool
+vm_handle_wp (struct page *page) {
+	uint64_t *pml4 = thread_current ()->pml4;
+	struct frame *old, *new;
+	void *kva;
+
+	/* The last page to share a frame keeps it. */
+	lock_acquire (&frame_lock);
+	old = page_frame_wait (page);
+	if (old == NULL) {
+		/* Evicted since the fault; fault again to bring it back. */
+		lock_release (&frame_lock);
+		return true;
+	}
+	if (old == &zero_frame)
+		zero_cow_cnt++;
+	else if (old->ref_cnt == 1) {
+		ASSERT (old->page == page);
+		old->merged = false;
+		lock_release (&frame_lock);
+		pml4_set_writable (pml4, page->va, true);
+		return true;
+	}
+	kva = old->kva;
+	lock_release (&frame_lock);
+
+	/* Otherwise copy it.  If OLD is evicted meanwhile, the copy may
+	 * be torn, so it is dropped and the fault taken again. */
+	new = vm_get_frame ();
+	if (new == NULL)
+		return false;
+	memcpy (new->kva, kva, PGSIZE);
+	lock_acquire (&frame_lock);
+	if (page_frame_wait (page) != old) {
+		frame_release (new);
+		lock_release (&frame_lock);
+		return true;
+	}
+	frame_attach (new, page);
+	if (old->merged)
+		ksm_unmerge_cnt++;
+	frame_put (old, page);
+	if (old != &zero_frame)
+		cow_cnt++;
+	lock_release (&frame_lock);
+
+	if (!pml4_set_page (pml4, page->va, new->kva, true)) {
+		vm_free_frame (page);
+		return false;
+	}
+	pml4_set_dirty (pml4, page->va, true);
+	new->pinned = false;
+	return true;
+}
+
+/* Return true on success */
+bool
+vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr,
+		bool user UNUSED, bool write, bool not_present) {
+	return vm_handle_fault (addr, write, not_present) != FAULT_INVALID;
+}
+
+/* Resolves a fault at ADDR of the current process, if it is a valid
+ * access, and returns what it took, or FAULT_INVALID if it is not. */
+enum fault_cause
+vm_handle_fault (void *addr, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page = NULL;
+	enum fault_cause cause;
+
+	if (addr == NULL || !is_user_vaddr (addr))
+		return FAULT_INVALID;
+
+	if (vm_huge_pages && not_present && spt_find_page (spt, addr) == NULL
+			&& huge_fault (spt, addr)) {
+		fault_cnt++;
+		return FAULT_ZERO;
+	}
+	page = spt_get_page (spt, addr);
+	if (page == NULL || (write && !page->writable))
+		return FAULT_INVALID;
+	if (!not_present)
+		return write && vm_handle_wp (page) ? FAULT_COW : FAULT_INVALID;
+
+	/* Wait out an eviction of PAGE that is in progress.  If the
+	 * eviction gave up, the page is mapped again. */
+	lock_acquire (&frame_lock);
+	if (page_frame_wait (page) != NULL) {
+		lock_release (&frame_lock);
+		return FAULT_MINOR;
+	}
+	lock_release (&frame_lock);
+
+	fault_cnt++;
+	if (!write && is_zero_fill (page))
+		return map_zero_page (page) ? FAULT_ZERO : FAULT_INVALID;
+	if (is_file_fill (page)) {
+		file_fault_cnt++;
+		if (!claim_file_page (page, false))
+			return FAULT_INVALID;
+		fault_around (page);
+		return FAULT_FILE;
+	}
+
+	if (VM_TYPE (page->operations->type) == VM_ANON && anon_is_swapped (page))
+		cause = FAULT_SWAP;
+	else if (page->region == NULL)
+		cause = FAULT_OTHER;
+	else
+		cause = FAULT_ZERO;
+	if (!vm_do_claim_page (page))
+		return FAULT_INVALID;
+	if (VM_TYPE (page->operations->type) == VM_ANON)
+		anon_swap_readahead (page);
+	return cause;
+}
+
+/* Returns true if non-resident PAGE would be filled from the file
+ * of its region. */
+static bool
+is_file_fill (const struct page *page) {
+	enum vm_type type = VM_TYPE (page->operations->type);
+
+	if (page->region == NULL || page->region->file == NULL)
+		return false;
+	if (type == VM_ANON)
+		return !anon_is_swapped (page) && !page->anon.modified;
+	return (type == VM_UNINIT || type == VM_FILE) && !is_zero_fill (page);
+}
+
+/* Returns the page cache through which PAGE, which is_file_fill()
+ * accepts, is shared with every other page of the same file data:
+ * text_cache for read-only executable data, file_cache for a page of
+ * a shared mapping that holds file data.  Returns NULL if PAGE is
+ * private to its process. */
+static struct hash *
+page_cache (const struct page *page) {
+	struct vm_region *region = page->region;
+
+	if (VM_TYPE (region->type) == VM_FILE)
+		return (size_t) (page->va - region->start) < region->read_bytes
+			? &file_cache : NULL;
+	return !region->writable ? &text_cache : NULL;
+}
+
+/* Brings in PAGE, which is_file_fill() accepts.  If page_cache()
+ * has a cache for it, the frame of the same file data is mapped from
+ * there if there is one, or else a new frame is added to the cache
+ * and then read in, so that faults on the same data meanwhile wait for
+ * it rather than read a copy of their own.  With PREFETCH, only a free
+ * frame is used, as vm_prefetch_page() does. */
+static bool
+claim_file_page (struct page *page, bool prefetch) {
+	struct hash *table = page_cache (page);
+	struct cache_entry key, *entry;
+	struct frame *frame;
+
+	if (table == NULL)
+		return prefetch ? vm_prefetch_page (page) : vm_do_claim_page (page);
+
+	cache_key (page, &key);
+	lock_acquire (&frame_lock);
+	frame = cache_find (table, key.inode, key.offset, key.read_bytes);
+	/* Mapped while frame_lock is held, since the frame could be
+	 * evicted as soon as PAGE is in its reverse map. */
+	if (frame != NULL) {
+		bool success = false;
+
+		/* Without its initializer, swap_in() only sets up the type of
+		 * an uninit PAGE and leaves the frame's contents alone. */
+		if (VM_TYPE (page->operations->type) == VM_UNINIT)
+			page->uninit.init = NULL;
+		if (swap_in (page, frame->kva)
+				&& rmap_add (frame, page, thread_current ())) {
+			page->frame = frame;
+			success = pml4_set_page (thread_current ()->pml4, page->va,
+					frame->kva, page->writable);
+			if (!success) {
+				page->frame = NULL;
+				frame_put (frame, page);
+			} else if (table == &text_cache)
+				text_hit_cnt++;
+			else
+				file_hit_cnt++;
+		}
+		lock_release (&frame_lock);
+		return success;
+	}
+	lock_release (&frame_lock);
+
+	entry = malloc (sizeof *entry);
+	frame = prefetch ? frame_get (false) : vm_get_frame ();
+	if (entry == NULL || frame == NULL) {
+		free (entry);
+		if (frame != NULL) {
+			lock_acquire (&frame_lock);
+			frame_release (frame);
+			lock_release (&frame_lock);
+		}
+		return false;
+	}
+
+	lock_acquire (&frame_lock);
+	if (cache_find (table, key.inode, key.offset, key.read_bytes) != NULL) {
+		/* Cached meanwhile: map that frame instead. */
+		frame_release (frame);
+		lock_release (&frame_lock);
+		free (entry);
+		return claim_file_page (page, prefetch);
+	}
+	frame_attach (frame, page);
+	*entry = key;
+	entry->table = table;
+	entry->inode = inode_reopen (key.inode);
+	entry->frame = frame;
+	hash_insert (table, &entry->elem);
+	frame->cache = entry;
+	lock_release (&frame_lock);
+	return frame_fill (frame, page);
+}
+
+/* Fills in the page cache key of the file data in PAGE. */
+static void
+cache_key (const struct page *page, struct cache_entry *key) {
+	struct vm_region *region = page->region;
+	size_t ofs = page->va - region->start;
+
+	key->table = NULL;
+	key->inode = file_get_inode (region->file);
+	key->offset = region->offset + ofs;
+	key->read_bytes = 0;
+	if (ofs < region->read_bytes)
+		key->read_bytes = region->read_bytes - ofs < PGSIZE
+			? region->read_bytes - ofs : PGSIZE;
+	key->frame = NULL;
+}
+
+/* Returns the frame that TABLE holds for the page at OFFSET in INODE,
+ * with READ_BYTES bytes from it, or NULL if there is none.  If the
+ * frame is still being read in, waits for that to finish, releasing
+ * frame_lock meanwhile.  Must be called with frame_lock held. */
+static struct frame *
+cache_find (struct hash *table, struct inode *inode, off_t offset,
+		size_t read_bytes) {
+	struct cache_entry key;
+	struct hash_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	key.inode = inode;
+	key.offset = offset;
+	key.read_bytes = read_bytes;
+	for (;;) {
+		struct frame *frame;
+
+		e = hash_find (table, &key.elem);
+		if (e == NULL)
+			return NULL;
+		frame = hash_entry (e, struct cache_entry, elem)->frame;
+		if (!frame->pinned)
+			return frame;
+		/* Sleep rather than yield, in case the reader has lower
+		 * priority. */
+		lock_release (&frame_lock);
+		timer_sleep (1);
+		lock_acquire (&frame_lock);
+	}
+}
+
+/* Returns the frame of PAGE, or NULL if it has none, once no eviction
+ * of the frame is in progress.  vm_evict_frame() releases frame_lock
+ * while it writes a frame out, and the frame's pages must be left
+ * alone until it is done.  Must be called with frame_lock held. */
+static struct frame *
+page_frame_wait (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	/* Sleep rather than yield, in case the evicting thread has lower
+	 * priority. */
+	while (page->frame != NULL && page->frame->evicting) {
+		lock_release (&frame_lock);
+		timer_sleep (1);
+		lock_acquire (&frame_lock);
+	}
+	return page->frame;
+}
+
+/* Returns the frame that file_cache holds for the page at OFFSET in
+ * INODE, which is LENGTH bytes long, if it holds the file data all the
+ * way to the end of the page or of the file, or NULL if there is none.
+ * Must be called with frame_lock held. */
+static struct frame *
+file_cache_find (struct inode *inode, off_t offset, off_t length) {
+	return cache_find (&file_cache, inode, offset,
+			length - offset < PGSIZE ? length - offset : PGSIZE);
+}
+
+/* Removes FRAME from the page cache, if it is there, because its
+ * contents are going away.  Must be called with frame_lock held. */
+static void
+cache_forget (struct frame *frame) {
+	struct cache_entry *entry = frame->cache;
+
+	if (entry == NULL)
+		return;
+	hash_delete (entry->table, &entry->elem);
+	inode_close (entry->inode);
+	free (entry);
+	frame->cache = NULL;
+}
+
+/* Reads SIZE bytes from INODE, starting at OFFSET, into BUFFER, like
+ * inode_read_at(), but takes the pages that shared mappings of INODE
+ * have in the file cache from memory, where they may be newer than on
+ * disk.  Returns the number of bytes read, which is less than SIZE at
+ * the end of the file or if memory runs out. */
+off_t
+vm_cache_read (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
+	uint8_t *buffer = buffer_;
+	off_t length = inode_length (inode);
+	off_t bytes_read = 0;
+	uint8_t *bounce = NULL;
+
+	while (bytes_read < size && offset < length) {
+		off_t page_ofs = offset % PGSIZE;
+		off_t chunk = PGSIZE - page_ofs;
+		struct frame *frame;
+
+		if (chunk > size - bytes_read)
+			chunk = size - bytes_read;
+		if (chunk > length - offset)
+			chunk = length - offset;
+
+		lock_acquire (&frame_lock);
+		frame = file_cache_find (inode, offset - page_ofs, length);
+		if (frame == NULL) {
+			lock_release (&frame_lock);
+			if (inode_read_at (inode, buffer + bytes_read, chunk, offset)
+					!= chunk)
+				break;
+		} else {
+			/* Copied out while the frame cannot go away, and then to
+			 * BUFFER, which may fault. */
+			if (bounce == NULL
+					&& (bounce = palloc_get_page (0)) == NULL) {
+				lock_release (&frame_lock);
+				break;
+			}
+			memcpy (bounce, frame->kva + page_ofs, chunk);
+			cache_read_cnt += chunk;
+			lock_release (&frame_lock);
+			memcpy (buffer + bytes_read, bounce, chunk);
+		}
+		bytes_read += chunk;
+		offset += chunk;
+	}
+	palloc_free_page (bounce);
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET, like
+ * inode_write_at(), but into the pages that shared mappings of INODE
+ * have in the file cache where there are any.  Those are marked dirty,
+ * to be written back with the changes made through the mappings.
+ * Returns the number of bytes written, which is less than SIZE at the
+ * end of the file or if memory runs out. */
+off_t
+vm_cache_write (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset) {
+	const uint8_t *buffer = buffer_;
+	off_t length = inode_length (inode);
+	off_t bytes_written = 0;
+	uint8_t *bounce = NULL;
+
+	if (inode_write_denied (inode))
+		return 0;
+
+	while (bytes_written < size && offset < length) {
+		off_t page_ofs = offset % PGSIZE;
+		off_t chunk = PGSIZE - page_ofs;
+		struct frame *frame;
+
+		if (chunk > size - bytes_written)
+			chunk = size - bytes_written;
+		if (chunk > length - offset)
+			chunk = length - offset;
+
+		lock_acquire (&frame_lock);
+		frame = file_cache_find (inode, offset - page_ofs, length);
+		lock_release (&frame_lock);
+		if (frame == NULL) {
+			off_t written = inode_write_at (inode, buffer + bytes_written,
+					chunk, offset);
+
+			if (written != chunk) {
+				bytes_written += written;
+				break;
+			}
+		} else {
+			/* Copied from BUFFER, which may fault, first. */
+			if (bounce == NULL && (bounce = palloc_get_page (0)) == NULL)
+				break;
+			memcpy (bounce, buffer + bytes_written, chunk);
+			lock_acquire (&frame_lock);
+			frame = file_cache_find (inode, offset - page_ofs, length);
+			if (frame != NULL) {
+				memcpy (frame->kva + page_ofs, bounce, chunk);
+				pml4_set_dirty (frame->owner->pml4, frame->page->va, true);
+				cache_write_cnt += chunk;
+			}
+			lock_release (&frame_lock);
+
+			/* The copy may have faulted and evicted the frame, which
+			 * put the page back on disk: write it there instead. */
+			if (frame == NULL) {
+				off_t written = inode_write_at (inode, bounce, chunk, offset);
+
+				if (written != chunk) {
+					bytes_written += written;
+					break;
+				}
+			}
+		}
+		bytes_written += chunk;
+		offset += chunk;
+	}
+	palloc_free_page (bounce);
+	return bytes_written;
+}
+
+/* Returns a hash of page cache entry E. */
+static uint64_t
+cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct cache_entry *t = hash_entry (e, struct cache_entry, elem);
+
+	return hash_bytes (&t->inode, sizeof t->inode)
+		^ hash_int (t->offset) ^ hash_int (t->read_bytes);
+}
+
+/* Returns true if page cache entry A is less than B. */
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct cache_entry *a = hash_entry (a_, struct cache_entry, elem);
+	const struct cache_entry *b = hash_entry (b_, struct cache_entry, elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	if (a->offset != b->offset)
+		return a->offset < b->offset;
+	return a->read_bytes < b->read_bytes;
+}
+
+/* Maps the HUGE_PGSIZE block that contains ADDR with one huge frame,
+ * if the block lies in a writable region where it would only be
+ * zero-filled, none of its pages exist yet, and the user pool has a
+ * free aligned block of HUGE_PAGE_CNT frames.  Returns true if
+ * successful; otherwise the fault is to be handled page by page. */
+static bool
+huge_fault (struct supplemental_page_table *spt, void *addr) {
+	void *base = (void *) ROUND_DOWN ((uintptr_t) addr, HUGE_PGSIZE);
+	struct vm_region *region = spt_find_region (spt, addr);
+	struct page key = { .va = base };
+	struct rb_elem *e;
+	struct frame *frame;
+	struct page *page;
+	void *kva;
+	bool over;
+
+	if (region == NULL || VM_TYPE (region->type) != VM_ANON
+			|| !region->writable || base < region->start
+			|| base + HUGE_PGSIZE > region->end
+			|| (size_t) (base - region->start) < region->read_bytes)
+		return false;
+	e = rb_ceiling (&spt->pages, &key.spt_elem);
+	if (e != NULL && rb_entry (e, struct page, spt_elem)->va
+			< base + HUGE_PGSIZE)
+		return false;
+	lock_acquire (&frame_lock);
+	over = rss_at_limit (thread_current (), HUGE_PAGE_CNT);
+	lock_release (&frame_lock);
+	if (over)
+		return false;
+
+	kva = palloc_get_aligned (PAL_USER | PAL_ZERO, HUGE_PAGE_CNT,
+			HUGE_PAGE_CNT);
+	if (kva == NULL) {
+		huge_fallback_cnt++;
+		return false;
+	}
+	frame = malloc (sizeof *frame);
+	page = page_create (base, region->type, true, region, NULL, NULL);
+	if (frame == NULL || page == NULL || !spt_insert_page (spt, page)) {
+		palloc_free_multiple (kva, HUGE_PAGE_CNT);
+		free (frame);
+		free (page);
+		return false;
+	}
+	/* With no initializer, this only makes PAGE anonymous. */
+	swap_in (page, kva);
+	page->huge = true;
+
+	lock_acquire (&frame_lock);
+	frame_init (frame, kva);
+	frame->huge = true;
+	frame->pinned = true;
+	list_insert (clock_hand != NULL ? clock_hand : list_end (&frame_list),
+			&frame->elem);
+	frame_cnt++;
+	frame_attach (frame, page);
+	if (wmark_low > 0)
+		pageout_check ();
+	lock_release (&frame_lock);
+
+	if (!pml4_set_huge_page (thread_current ()->pml4, base, kva, true)) {
+		spt_remove_page (spt, page);
+		return false;
+	}
+	frame->pinned = false;
+	huge_fault_cnt++;
+	return true;
+}
+
+/* Splits huge PAGE, which must be in memory, into HUGE_PAGE_CNT pages,
+ * each with a frame of its own, that map the same memory with the
+ * same accessed and dirty bits.  PAGE keeps the first one.  Returns
+ * false if memory runs out, leaving PAGE whole.  Must be called with
+ * frame_lock and the SPT lock of the owner of PAGE held. */
+static bool
+huge_split (struct page *page) {
+	struct frame *frame = page->frame;
+	struct thread *owner = frame->owner;
+	struct list_elem *next = list_next (&frame->elem);
+	size_t cnt = HUGE_PAGE_CNT - 1;
+	struct page **pages = malloc (cnt * sizeof *pages);
+	struct frame **frames = malloc (cnt * sizeof *frames);
+	size_t i = 0;
+	bool ok = pages != NULL && frames != NULL;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (lock_held_by_current_thread (&owner->spt.lock));
+	ASSERT (page->huge && frame->huge);
+
+	for (; ok && i < cnt; i++) {
+		pages[i] = page_create (page->va + (i + 1) * PGSIZE, VM_ANON,
+				page->writable, page->region, NULL, NULL);
+		frames[i] = malloc (sizeof *frames[i]);
+		if (pages[i] == NULL || frames[i] == NULL) {
+			free (pages[i]);
+			free (frames[i]);
+			ok = false;
+			break;
+		}
+	}
+	if (ok)
+		ok = pml4_split_huge_page (owner->pml4, page->va);
+	if (!ok) {
+		while (i-- > 0) {
+			free (pages[i]);
+			free (frames[i]);
+		}
+		free (pages);
+		free (frames);
+		return false;
+	}
+
+	/* Just after FRAME in the frame table, in order. */
+	for (i = 0; i < cnt; i++) {
+		swap_in (pages[i], NULL);
+		frame_init (frames[i], frame->kva + (i + 1) * PGSIZE);
+		frames[i]->page = pages[i];
+		frames[i]->owner = owner;
+		frames[i]->pinned = false;
+		list_insert (next, &frames[i]->elem);
+		frame_cnt++;
+		pages[i]->frame = frames[i];
+		rb_insert (&owner->spt.pages, &pages[i]->spt_elem);
+	}
+	free (pages);
+	free (frames);
+	page->huge = false;
+	frame->huge = false;
+	huge_split_cnt++;
+	return true;
+}
+
+/* Splits huge FRAME so that its first page can be evicted, unless its
+ * owner is changing its SPT right now.  Returns true if successful.
+ * Must be called with frame_lock held. */
+static bool
+huge_try_split (struct frame *frame) {
+	struct lock *lock = &frame->owner->spt.lock;
+	bool ok;
+
+	if (!lock_try_acquire (lock))
+		return false;
+	ok = huge_split (frame->page);
+	lock_release (lock);
+	return ok;
+}
+
+/* Splits the huge page of the current process that covers VA, if
+ * there is one and VA is not its start.  Returns false if that fails
+ * for lack of memory. */
+static bool
+huge_split_at (struct supplemental_page_table *spt, void *va) {
+	struct page *page = spt_find_page (spt, va);
+	bool ok = true;
+
+	if (page == NULL || !page->huge || page->va == va)
+		return true;
+	lock_acquire (&frame_lock);
+	lock_acquire (&spt->lock);
+	ok = huge_split (page);
+	lock_release (&spt->lock);
+	lock_release (&frame_lock);
+	return ok;
+}
+
+/* Returns true if FRAME holds the only mapping of an anonymous page,
+ * which could be merged into an identical frame.  Must be called with
+ * frame_lock held. */
+static bool
+ksm_candidate (const struct frame *frame) {
+	struct page *page = frame->page;
+
+	return !frame->pinned && frame->ref_cnt == 1 && frame->cache == NULL
+		&& !frame->huge && page != NULL && page->frame == frame
+		&& VM_TYPE (page->operations->type) == VM_ANON
+		&& frame->owner->pml4 != NULL;
+}
+
+/* Returns true if pages could be merged into FRAME.  Must be called
+ * with frame_lock held. */
+static bool
+ksm_target (const struct frame *frame) {
+	return frame->merged
+		? !frame->pinned && frame->cache == NULL
+		: ksm_candidate (frame);
+}
+
+/* Write-protects the mapping of FRAME, which must not be merged yet,
+ * or makes it writable again if WRITABLE and its page allows it. */
+static void
+ksm_protect (struct frame *frame, bool writable) {
+	if (!frame->merged)
+		pml4_set_writable (frame->owner->pml4, frame->page->va,
+				writable && frame->page->writable);
+}
+
+/* Makes the page of DROP, a ksm_candidate(), map KEEP instead, if
+ * their contents are the same, and frees DROP.  Returns true if
+ * successful.  Must be called with frame_lock held. */
+static bool
+ksm_merge (struct frame *keep, struct frame *drop) {
+	struct page *page = drop->page;
+	uint64_t *pml4 = drop->owner->pml4;
+	bool dirty;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	/* Writes from now on fault and wait for frame_lock, so the
+	 * contents cannot change between comparing and merging. */
+	ksm_protect (keep, false);
+	ksm_protect (drop, false);
+	if (memcmp (keep->kva, drop->kva, PGSIZE)) {
+		ksm_protect (keep, true);
+		ksm_protect (drop, true);
+		return false;
+	}
+
+	/* The page table page already exists, so this cannot fail. */
+	if (!rmap_add (keep, page, drop->owner)) {
+		ksm_protect (keep, true);
+		ksm_protect (drop, true);
+		return false;
+	}
+	dirty = pml4_is_dirty (pml4, page->va);
+	pml4_set_page (pml4, page->va, keep->kva, false);
+	if (dirty)
+		pml4_set_dirty (pml4, page->va, true);
+	keep->merged = true;
+	page->frame = keep;
+	rmap_remove (drop, page);
+	frame_release (drop);
+	ksm_merge_cnt++;
+	return true;
+}
+
+/* Hashes FRAME and merges it with an identical frame, if the table
+ * has one.  Must be called with frame_lock held. */
+static void
+ksm_scan (struct frame *frame) {
+	struct hash_elem *e;
+	struct frame *twin;
+	uint64_t sum;
+
+	if (!ksm_target (frame))
+		return;
+	ksm_scan_cnt++;
+	ksm_forget (frame);
+	sum = hash_bytes (frame->kva, PGSIZE);
+	if (!frame->merged && sum != frame->sum) {
+		/* Changed since the last sweep; try again next time. */
+		frame->sum = sum;
+		return;
+	}
+	frame->sum = sum;
+
+	e = hash_insert (&ksm_table, &frame->ksm_elem);
+	if (e == NULL) {
+		frame->listed = true;
+		return;
+	}
+	twin = hash_entry (e, struct frame, ksm_elem);
+	if (!frame->merged && ksm_target (twin) && ksm_merge (twin, frame))
+		return;
+	if (frame->merged && ksm_candidate (twin) && ksm_merge (frame, twin)) {
+		/* Freeing TWIN took it out of the table. */
+		hash_insert (&ksm_table, &frame->ksm_elem);
+		frame->listed = true;
+		return;
+	}
+
+	/* Different contents with the same hash, or TWIN went away: FRAME
+	 * is the better bet for later frames. */
+	hash_replace (&ksm_table, &frame->ksm_elem);
+	twin->listed = false;
+	frame->listed = true;
+}
+
+/* Removes FRAME from the merge table, if it is there.  Must be called
+ * with frame_lock held. */
+static void
+ksm_forget (struct frame *frame) {
+	if (frame->listed) {
+		hash_delete (&ksm_table, &frame->ksm_elem);
+		frame->listed = false;
+	}
+}
+
+/* Destructor for emptying the merge table. */
+static void
+ksm_unlist (struct hash_elem *e, void *aux UNUSED) {
+	hash_entry (e, struct frame, ksm_elem)->listed = false;
+}
+
+/* The ksm thread.  Every vm_ksm_interval ms, scans the next
+ * vm_ksm_pages frames of the frame table for pages to merge. */
+static void
+ksm (void *aux UNUSED) {
+	int64_t ticks = (int64_t) vm_ksm_interval * TIMER_FREQ / 1000;
+
+	if (ticks < 1)
+		ticks = 1;
+	for (;;) {
+		timer_sleep (ticks);
+		lock_acquire (&frame_lock);
+		for (unsigned i = 0; i < vm_ksm_pages && frame_cnt > 0; i++) {
+			struct frame *frame;
+
+			if (ksm_hand == NULL || ksm_hand == list_end (&frame_list)) {
+				if (ksm_hand != NULL) {
+					hash_clear (&ksm_table, ksm_unlist);
+					ksm_sweep_cnt++;
+				}
+				ksm_hand = list_begin (&frame_list);
+			}
+			frame = list_entry (ksm_hand, struct frame, elem);
+			ksm_hand = list_next (ksm_hand);
+			ksm_scan (frame);
+		}
+		lock_release (&frame_lock);
+	}
+}
+
+/* Returns the hash of the contents of the frame of E. */
+static uint64_t
+ksm_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct frame, ksm_elem)->sum;
+}
+
+/* Orders frames in the merge table by the hash of their contents. */
+static bool
+ksm_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct frame *a = hash_entry (a_, struct frame, ksm_elem);
+	const struct frame *b = hash_entry (b_, struct frame, ksm_elem);
+
+	return a->sum < b->sum;
+}
+
+/* Maps pages of PAGE's region near PAGE, which was just read from a
+ * file, so that the process does not fault on each of them in turn.
+ * Normally the vm_fault_around pages of the aligned block that
+ * contains PAGE are mapped.  A fault just past the pages mapped last
+ * time is taken to be a sequential scan, and the window ahead of it
+ * doubles, up to FAULT_AROUND_MAX pages.  A region advised
+ * MADV_SEQUENTIAL gets the largest window ahead of every fault, and
+ * one advised MADV_RANDOM none.  Only free frames are used, and pages
+ * that are in memory already or hold data that did not come from the
+ * file are left alone. */
+static void
+fault_around (struct page *page) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_region *region = page->region;
+	size_t window = vm_fault_around;
+	void *start, *end, *va;
+
+	if (region->advice == MADV_RANDOM)
+		return;
+	if (region->advice == MADV_SEQUENTIAL) {
+		/* Read as far ahead as we would ever go. */
+		if (window < FAULT_AROUND_MAX)
+			window = FAULT_AROUND_MAX;
+		start = page->va;
+	} else if (window <= 1)
+		return;
+	else if (page->va == region->ra_next) {
+		window = region->ra_pages * 2;
+		if (window < vm_fault_around)
+			window = vm_fault_around;
+		else if (window > FAULT_AROUND_MAX)
+			window = FAULT_AROUND_MAX > vm_fault_around
+				? FAULT_AROUND_MAX : vm_fault_around;
+		start = page->va;
+	} else
+		start = (void *) ROUND_DOWN ((uintptr_t) page->va, window * PGSIZE);
+	if (start < region->start)
+		start = region->start;
+	end = start + window * PGSIZE;
+	if (end > region->end || end < start)
+		end = region->end;
+
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *p;
+
+		if (va == page->va)
+			continue;
+		p = spt_get_page (spt, va);
+		if (p == NULL || p->frame != NULL || !is_file_fill (p))
+			continue;
+		if (!claim_file_page (p, true))
+			break;
+		around_cnt++;
+	}
+	region->ra_next = va;
+	region->ra_pages = (va - start) / PGSIZE;
+}
+
+/* Free the page.
+ * DO NOT MODIFY THIS FUNCTION. */
+void
+vm_dealloc_page (struct page *page) {
+	destroy (page);
+	free (page);
+}
+
+/* Claim the page that allocate on VA. */
+bool
+vm_claim_page (void *va) {
+	struct page *page = spt_get_page (&thread_current ()->spt, va);
+
+	if (page == NULL)
+		return false;
+	return vm_do_claim_page (page);
+}
+
+/* Claim the PAGE and set up the mmu. */
+static bool
+vm_do_claim_page (struct page *page) {
+	struct frame *frame = vm_get_frame ();
+
+	if (frame == NULL)
+		return false;
+
+	/* Set links */
+	lock_acquire (&frame_lock);
+	frame_attach (frame, page);
+	lock_release (&frame_lock);
+
+	/* Fill the frame before the process can see it. */
+	return frame_fill (frame, page);
+}
+
+/* Initialize new supplemental page table */
+void
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	rb_init (&spt->regions, region_less, NULL);
+	rb_init (&spt->pages, page_less, NULL);
+	lock_init (&spt->lock);
+	spt->owner = thread_current ();
+}
+
+/* Copy supplemental page table from src to dst */
+bool
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct rb_elem *e;
+
+	for (e = rb_first (&src->regions); e != NULL; e = rb_next (e)) {
+		struct vm_region *r = rb_entry (e, struct vm_region, elem);
+		struct vm_region *copy = malloc (sizeof *copy);
+
+		if (copy == NULL)
+			return false;
+		*copy = *r;
+		if (r->file != NULL && (copy->file = file_reopen (r->file)) == NULL) {
+			free (copy);
+			return false;
+		}
+		if (!spt_insert_region (dst, copy)) {
+			file_close (copy->file);
+			free (copy);
+			return false;
+		}
+	}
+
+	for (e = rb_first (&src->pages); e != NULL; e = rb_next (e)) {
+		struct page *page = rb_entry (e, struct page, spt_elem);
+		struct vm_region *region = NULL;
+		struct page *child;
+
+		if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+			/* Region pages are materialized again in DST on demand. */
+			if (page->region == NULL
+					&& !vm_alloc_page_with_initializer (page->uninit.type,
+						page->va, page->writable, page->uninit.init,
+						page->uninit.aux))
+				return false;
+			continue;
+		}
+
+		if (page->region != NULL)
+			region = spt_find_region (dst, page->va);
+
+		/* An evicted anonymous page that was saved to swap is read
+		 * straight into the child; any other evicted page is clean, so
+		 * the child can rebuild it the same way the parent will. */
+		lock_acquire (&frame_lock);
+		page_frame_wait (page);
+		if (page->frame == NULL
+				&& VM_TYPE (page->operations->type) == VM_ANON
+				&& anon_is_swapped (page)) {
+			lock_release (&frame_lock);
+			child = page_create (page->va, page_get_type (page),
+					page->writable, region, NULL, NULL);
+			if (child == NULL || !spt_insert_page (dst, child)) {
+				free (child);
+				return false;
+			}
+			if (!vm_do_claim_page (child)
+					|| !anon_read_swap (page, child->frame->kva))
+				return false;
+			pml4_set_dirty (thread_current ()->pml4, child->va, true);
+			continue;
+		}
+		/* A page in the file cache is rebuilt the same way, and the
+		 * child's fault finds the parent's frame in the cache. */
+		if (page->frame == NULL || (page->frame->cache != NULL
+					&& VM_TYPE (page->operations->type) == VM_FILE)) {
+			lock_release (&frame_lock);
+			child = page_create (page->va, page_get_type (page),
+					page->writable, region,
+					region != NULL ? region_load : zero_fill, region);
+			if (child == NULL)
+				return false;
+			if (!spt_insert_page (dst, child)) {
+				free (child);
+				return false;
+			}
+			continue;
+		}
+		if (page->frame == &zero_frame) {
+			/* Only read so far: the child maps the zero frame too,
+			 * which is in no reverse map and never pinned. */
+			lock_release (&frame_lock);
+			child = page_create (page->va, page_get_type (page),
+					page->writable, region, NULL, NULL);
+			if (child == NULL)
+				return false;
+			if (!spt_insert_page (dst, child)) {
+				free (child);
+				return false;
+			}
+			if (!map_zero_page (child))
+				return false;
+			continue;
+		}
+		if (page->frame->huge) {
+			/* Share it page by page. */
+			bool ok;
+
+			lock_acquire (&src->lock);
+			ok = huge_split (page);
+			lock_release (&src->lock);
+			if (!ok) {
+				lock_release (&frame_lock);
+				return false;
+			}
+		}
+		page->frame->pinned = true;
+		lock_release (&frame_lock);
+
+		if (VM_TYPE (page->operations->type) == VM_ANON) {
+			if (!share_page (dst, src, page, region)) {
+				page->frame->pinned = false;
+				return false;
+			}
+			continue;
+		}
+
+		/* Copy a page that is in memory into a fresh frame. */
+		child = page_create (page->va, page_get_type (page), page->writable,
+				region, NULL, NULL);
+		if (child == NULL || !spt_insert_page (dst, child)) {
+			free (child);
+			page->frame->pinned = false;
+			return false;
+		}
+		if (!vm_do_claim_page (child)) {
+			page->frame->pinned = false;
+			return false;
+		}
+		memcpy (child->frame->kva, page->frame->kva, PGSIZE);
+		page->frame->pinned = false;
+
+		/* The copy exists only in memory. */
+		pml4_set_dirty (thread_current ()->pml4, child->va, true);
+	}
+	return true;
+}
+
+/* Gives DST, the SPT of the current process, a page that shares the
+ * frame of anonymous PAGE in SRC, whose frame the caller has pinned.
+ * Both processes map the frame read-only, and the first to write to
+ * it gets a copy from vm_handle_wp().  Unpins PAGE's frame on
+ * success. */
+static bool
+share_page (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src, struct page *page,
+		struct vm_region *region) {
+	struct frame *frame = page->frame;
+	uint64_t *pml4 = thread_current ()->pml4;
+	struct page *child;
+
+	child = page_create (page->va, page_get_type (page), page->writable,
+			region, NULL, NULL);
+	if (child == NULL)
+		return false;
+	if (!spt_insert_page (dst, child)) {
+		free (child);
+		return false;
+	}
+
+	/* With no initializer, this only makes CHILD anonymous; the
+	 * frame's contents are left alone. */
+	if (!swap_in (child, frame->kva))
+		return false;
+
+	/* Mapped before FRAME is unpinned, since it could be evicted
+	 * through CHILD from then on. */
+	lock_acquire (&frame_lock);
+	if (!rmap_add (frame, child, thread_current ())) {
+		lock_release (&frame_lock);
+		return false;
+	}
+	child->frame = frame;
+	if (!pml4_set_page (pml4, child->va, frame->kva, false)) {
+		child->frame = NULL;
+		frame_put (frame, child);
+		lock_release (&frame_lock);
+		return false;
+	}
+	/* Unless the page is what its region would load, the child has
+	 * no copy of it anywhere else. */
+	if (page->region == NULL || page->anon.modified
+			|| anon_is_swapped (page)
+			|| pml4_is_dirty (src->owner->pml4, page->va))
+		pml4_set_dirty (pml4, child->va, true);
+	if (page->writable)
+		pml4_set_writable (src->owner->pml4, page->va, false);
+	frame->pinned = false;
+	share_cnt++;
+	lock_release (&frame_lock);
+	return true;
+}
+
+/* Destroys PAGE, as an action function for rb_clear(). */
+static void
+page_destructor (struct rb_elem *e, void *aux UNUSED) {
+	vm_dealloc_page (rb_entry (e, struct page, spt_elem));
+}
+
+/* Frees REGION, as an action function for rb_clear(). */
+static void
+region_destructor (struct rb_elem *e, void *aux UNUSED) {
+	struct vm_region *region = rb_entry (e, struct vm_region, elem);
+
+	file_close (region->file);
+	free (region);
+}
+
+/* Free the resource hold by the supplemental page table */
+void
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	struct thread *curr = thread_current ();
+	struct rb_elem *e;
+
+	/* Unmap everything with one TLB flush, then destroy the pages,
+	 * which writes back dirty file pages and frees the frames. */
+	if (curr->pml4 != NULL && !rb_empty (&spt->pages)) {
+		struct mmu_gather tlb;
+
+		mmu_gather_init (&tlb, curr->pml4);
+		for (e = rb_first (&spt->pages); e != NULL; e = rb_next (e)) {
+			struct page *page = rb_entry (e, struct page, spt_elem);
+			if (page->frame != NULL)
+				mmu_gather_clear_page (&tlb, page->va);
+		}
+		mmu_gather_finish (&tlb);
+	}
+
+	if (!rb_empty (&spt->pages) || !rb_empty (&spt->regions)) {
+		lock_acquire (&spt->lock);
+		rb_clear (&spt->pages, page_destructor);
+		rb_clear (&spt->regions, region_destructor);
+		lock_release (&spt->lock);
+	}
 }
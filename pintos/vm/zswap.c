@@ -0,0 +1,162 @@
+/* zswap.c: Compressed cache in front of the swap disk.
+ *
+ * An anonymous page that is evicted is compressed into a pool in
+ * kernel memory instead of being written to disk, if it shrinks
+ * enough.  Reading it back is then a decompression instead of 8
+ * sector transfers.  When the pool is full, the entries that have
+ * been there longest are written back to disk to make room.
+ *
+ * All functions here are called with the swap lock in anon.c held,
+ * which also protects the pool. */
+
+#include "vm/zswap.h"
+#include <list.h>
+#include <lz.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* A compressed page. */
+struct zswap_entry {
+	struct list_elem elem;      /* Element in lru_list. */
+	struct page *page;          /* Page it holds the contents of. */
+	size_t size;                /* Bytes in DATA. */
+	uint8_t data[];             /* Compressed contents. */
+};
+
+/* Pages that compress to more than this are sent to disk. */
+#define MAX_ZSIZE (PGSIZE * 3 / 4)
+
+unsigned zswap_percent = 20;
+
+/* Entries, most recently stored first. */
+static struct list lru_list;
+
+/* Bytes used by entries, and the most allowed. */
+static size_t pool_bytes;
+static size_t pool_limit;
+
+/* Scratch memory for compression and write-back. */
+static uint8_t zbuf[MAX_ZSIZE];
+static uint8_t zwork[LZ_WORK_SIZE];
+static uint8_t page_buf[PGSIZE];
+
+/* Statistics. */
+static long long store_cnt;       /* Pages stored. */
+static long long reject_cnt;      /* Pages that did not compress. */
+static long long load_cnt;        /* Pages loaded. */
+static long long writeback_cnt;   /* Entries written back to disk. */
+static long long stored_raw;      /* Bytes in pages in the pool. */
+
+static bool make_room (size_t bytes);
+static void free_entry (struct zswap_entry *entry);
+
+/* Sets up the pool. */
+void
+zswap_init (void) {
+	list_init (&lru_list);
+	pool_limit = (size_t) zswap_percent * palloc_user_page_cnt () / 100
+		* PGSIZE;
+}
+
+/* Compresses the page at KVA into the pool as the contents of
+ * PAGE.  Returns false if it does not compress well or there is no
+ * room for it. */
+bool
+zswap_store (struct page *page, const void *kva) {
+	struct zswap_entry *entry;
+	size_t size, bytes;
+
+	ASSERT (page->anon.zswap == NULL);
+
+	if (pool_limit == 0)
+		return false;
+	size = lz_compress (kva, PGSIZE, zbuf, sizeof zbuf, zwork);
+	if (size == 0) {
+		reject_cnt++;
+		return false;
+	}
+	bytes = sizeof *entry + size;
+	if (!make_room (bytes))
+		return false;
+	entry = malloc (bytes);
+	if (entry == NULL)
+		return false;
+
+	entry->page = page;
+	entry->size = size;
+	memcpy (entry->data, zbuf, size);
+	list_push_front (&lru_list, &entry->elem);
+	pool_bytes += bytes;
+	stored_raw += PGSIZE;
+	store_cnt++;
+	page->anon.zswap = entry;
+	return true;
+}
+
+/* Decompresses the contents of PAGE into KVA.  The entry is freed
+ * unless KEEP is true. */
+void
+zswap_load (struct page *page, void *kva, bool keep) {
+	struct zswap_entry *entry = page->anon.zswap;
+
+	if (lz_decompress (entry->data, entry->size, kva, PGSIZE) != PGSIZE)
+		PANIC ("zswap: corrupt entry for page %p", page->va);
+	load_cnt++;
+	if (!keep)
+		zswap_invalidate (page);
+}
+
+/* Frees the entry of PAGE, if any. */
+void
+zswap_invalidate (struct page *page) {
+	if (page->anon.zswap != NULL) {
+		free_entry (page->anon.zswap);
+		page->anon.zswap = NULL;
+	}
+}
+
+/* Prints compressed pool statistics. */
+void
+zswap_print_stats (void) {
+	if (pool_limit == 0)
+		return;
+	printf ("Zswap: %zu of %zu bytes hold %lld kB, compressed to %lld%%, "
+			"%lld stored, %lld loaded, %lld incompressible, "
+			"%lld written back\n",
+			pool_bytes, pool_limit, stored_raw / 1024,
+			stored_raw != 0 ? (long long) pool_bytes * 100 / stored_raw : 0,
+			store_cnt, load_cnt, reject_cnt, writeback_cnt);
+}
+
+/* Writes the oldest entries back to disk until BYTES more fit in
+ * the pool.  Returns false if that cannot be done. */
+static bool
+make_room (size_t bytes) {
+	if (bytes > pool_limit)
+		return false;
+	while (pool_bytes + bytes > pool_limit) {
+		struct zswap_entry *entry = list_entry (list_back (&lru_list),
+				struct zswap_entry, elem);
+		struct page *page = entry->page;
+
+		lz_decompress (entry->data, entry->size, page_buf, PGSIZE);
+		if (!anon_write_slot (page, page_buf))
+			return false;
+		zswap_invalidate (page);
+		writeback_cnt++;
+	}
+	return true;
+}
+
+/* Removes ENTRY from the pool and frees it. */
+static void
+free_entry (struct zswap_entry *entry) {
+	list_remove (&entry->elem);
+	pool_bytes -= sizeof *entry + entry->size;
+	stored_raw -= PGSIZE;
+	free (entry);
+}